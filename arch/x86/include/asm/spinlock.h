@@ -184,6 +184,14 @@ static inline int arch_spin_is_contended(arch_spinlock_t *lock)
 }
 #define arch_spin_is_contended	arch_spin_is_contended
 
+/* for lockref, which looks at a copy of the lock word */
+static __always_inline int arch_spin_value_unlocked(arch_spinlock_t lock)
+{
+	int tmp = lock.slock;
+
+	return !(((tmp >> TICKET_SHIFT) ^ tmp) & ((1 << TICKET_SHIFT) - 1));
+}
+
 static __always_inline void arch_spin_lock(arch_spinlock_t *lock)
 {
 	__ticket_spin_lock(lock);
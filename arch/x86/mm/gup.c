@@ -125,9 +125,21 @@ static noinline int gup_huge_pmd(pmd_t pmd, unsigned long addr,
 	VM_BUG_ON(pte_flags(pte) & _PAGE_SPECIAL);
 	VM_BUG_ON(!pfn_valid(pte_pfn(pte)));
 
-	refs = 0;
 	head = pte_page(pte);
 	page = head + ((addr & ~PMD_MASK) >> PAGE_SHIFT);
+	if (!PageHead(head)) {
+		/* pagecache mapped by a huge pmd is made of small pages */
+		do {
+			VM_BUG_ON(PageCompound(page));
+			pages[*nr] = page;
+			get_page(page);
+			(*nr)++;
+			page++;
+		} while (addr += PAGE_SIZE, addr != end);
+		return 1;
+	}
+
+	refs = 0;
 	do {
 		VM_BUG_ON(compound_head(page) != head);
 		pages[*nr] = page;
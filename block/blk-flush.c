@@ -62,6 +62,13 @@
  * The above peculiarity requires that each FLUSH/FUA request has only one
  * bio attached to it, which is guaranteed as they aren't allowed to be
  * merged in the usual way.
+ *
+ * Multiqueue devices have neither an elevator dispatch queue nor a
+ * queue_lock protected submission path, so flushes aren't merged there.
+ * Each sequenced request runs through its own steps instead, and the pre-
+ * and postflushes are separate tagged requests.  Those are allocated from
+ * kblockd, as getting a tag may have to sleep and flush completions can
+ * happen in interrupt context.
  */
 
 #include <linux/kernel.h>
@@ -69,6 +76,7 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/gfp.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
 
@@ -384,6 +392,136 @@ void blk_abort_flushes(struct request_queue *q)
 	}
 }
 
+static void mq_flush_complete_seq(struct request *rq, unsigned int seq,
+				  int error);
+
+static void mq_flush_end_io(struct request *flush_rq, int error)
+{
+	struct request *rq = flush_rq->end_io_data;
+
+	blk_mq_free_request(flush_rq);
+	mq_flush_complete_seq(rq, blk_flush_cur_seq(rq), error);
+}
+
+static void mq_flush_data_end_io(struct request *rq, int error)
+{
+	mq_flush_complete_seq(rq, REQ_FSEQ_DATA, error);
+}
+
+/*
+ * Same as blk_flush_complete_seq(), minus the merging of flushes.  Can be
+ * called from interrupt context.
+ */
+static void mq_flush_complete_seq(struct request *rq, unsigned int seq,
+				  int error)
+{
+	struct request_queue *q = rq->q;
+	unsigned long flags;
+
+	BUG_ON(rq->flush.seq & seq);
+	rq->flush.seq |= seq;
+
+	if (likely(!error))
+		seq = blk_flush_cur_seq(rq);
+	else
+		seq = REQ_FSEQ_DONE;
+
+	switch (seq) {
+	case REQ_FSEQ_PREFLUSH:
+	case REQ_FSEQ_POSTFLUSH:
+		spin_lock_irqsave(&q->mq_flush_lock, flags);
+		list_add_tail(&rq->flush.list, &q->mq_flush_list);
+		spin_unlock_irqrestore(&q->mq_flush_lock, flags);
+		kblockd_schedule_work(q, &q->mq_flush_work);
+		break;
+
+	case REQ_FSEQ_DATA:
+		rq->end_io = mq_flush_data_end_io;
+		blk_mq_insert_request(rq, false, true, true);
+		break;
+
+	case REQ_FSEQ_DONE:
+		blk_flush_restore_request(rq);
+		blk_mq_end_io(rq, error);
+		break;
+
+	default:
+		BUG();
+	}
+}
+
+/**
+ * blk_mq_flush_work - issue pending pre- and postflushes of a mq device
+ * @work: &request_queue->mq_flush_work
+ *
+ * Allocates a flush request for every sequenced request waiting on
+ * ->mq_flush_list and queues it.  The sequence continues from
+ * mq_flush_end_io() once the flush completes.
+ */
+void blk_mq_flush_work(struct work_struct *work)
+{
+	struct request_queue *q =
+		container_of(work, struct request_queue, mq_flush_work);
+	struct request *rq, *flush_rq;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&q->mq_flush_lock);
+	list_splice_init(&q->mq_flush_list, &list);
+	spin_unlock_irq(&q->mq_flush_lock);
+
+	while (!list_empty(&list)) {
+		rq = list_first_entry(&list, struct request, flush.list);
+		list_del_init(&rq->flush.list);
+
+		flush_rq = blk_mq_alloc_request(q, WRITE_FLUSH | REQ_FLUSH_SEQ,
+						GFP_NOIO, false);
+		flush_rq->cmd_type = REQ_TYPE_FS;
+		flush_rq->rq_disk = rq->rq_disk;
+		flush_rq->end_io = mq_flush_end_io;
+		flush_rq->end_io_data = rq;
+
+		blk_mq_insert_request(flush_rq, false, true, false);
+	}
+}
+
+/**
+ * blk_mq_insert_flush - insert a new FLUSH/FUA request on a mq device
+ * @rq: request to insert
+ *
+ * Counterpart of blk_insert_flush() for multiqueue devices, called from
+ * the submission path of @rq.
+ */
+void blk_mq_insert_flush(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	unsigned int fflags = q->flush_flags;	/* may change, cache */
+	unsigned int policy = blk_flush_policy(fflags, rq);
+
+	rq->cmd_flags &= ~REQ_FLUSH;
+	if (!(fflags & REQ_FUA))
+		rq->cmd_flags &= ~REQ_FUA;
+
+	if (!policy) {
+		blk_mq_end_io(rq, 0);
+		return;
+	}
+
+	BUG_ON(rq->bio != rq->biotail); /*assumes zero or single bio rq */
+
+	if ((policy & REQ_FSEQ_DATA) &&
+	    !(policy & (REQ_FSEQ_PREFLUSH | REQ_FSEQ_POSTFLUSH))) {
+		blk_mq_insert_request(rq, false, true, false);
+		return;
+	}
+
+	memset(&rq->flush, 0, sizeof(rq->flush));
+	INIT_LIST_HEAD(&rq->flush.list);
+	rq->cmd_flags |= REQ_FLUSH_SEQ;
+	rq->flush.saved_end_io = rq->end_io; /* Usually NULL */
+
+	mq_flush_complete_seq(rq, REQ_FSEQ_ACTIONS & ~policy, 0);
+}
+
 static void bio_end_flush(struct bio *bio, int err)
 {
 	if (err)
@@ -0,0 +1,217 @@
+/*
+ * Tag allocation for multiqueue block devices.
+ *
+ * Each hardware context owns a map of nr_tags tags.  The first
+ * reserved_tags of those are kept aside for internal and error handling
+ * requests, so that they can always make progress even when normal IO has
+ * exhausted the map.  Free tags are found with a lockless bitmap search
+ * that starts at a per-CPU hint, which keeps CPUs allocating from different
+ * words of the map instead of all hammering the first free bit.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+#include <linux/blk-mq.h>
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	unsigned int nr_reserved_tags;
+
+	unsigned long *free_map;
+	unsigned long *reserved_map;
+
+	unsigned int __percpu *hint;
+
+	wait_queue_head_t wait;
+};
+
+static int __blk_mq_get_tag_map(unsigned long *map, unsigned int depth,
+				unsigned int start)
+{
+	bool wrapped = false;
+	unsigned int tag;
+
+	if (start >= depth)
+		start = 0;
+
+	for (;;) {
+		tag = find_next_zero_bit(map, depth, start);
+		if (tag >= depth) {
+			/*
+			 * Searched to the end of the map, go around once
+			 * for the part before our starting point.
+			 */
+			if (wrapped || !start)
+				return -1;
+			wrapped = true;
+			start = 0;
+			continue;
+		}
+		if (!test_and_set_bit(tag, map))
+			return tag;
+		start = tag + 1;
+	}
+}
+
+static int __blk_mq_get_tag(struct blk_mq_tags *tags, bool reserved)
+{
+	unsigned int *hint;
+	int tag;
+
+	if (unlikely(reserved)) {
+		if (!tags->nr_reserved_tags)
+			return -1;
+		return __blk_mq_get_tag_map(tags->reserved_map,
+					    tags->nr_reserved_tags, 0);
+	}
+
+	hint = per_cpu_ptr(tags->hint, raw_smp_processor_id());
+	tag = __blk_mq_get_tag_map(tags->free_map,
+				   tags->nr_tags - tags->nr_reserved_tags,
+				   *hint);
+	if (tag < 0)
+		return -1;
+
+	*hint = tag + 1;
+	return tag + tags->nr_reserved_tags;
+}
+
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags, bool reserved)
+{
+	if (reserved)
+		return find_first_zero_bit(tags->reserved_map,
+			tags->nr_reserved_tags) < tags->nr_reserved_tags;
+
+	return find_first_zero_bit(tags->free_map,
+		tags->nr_tags - tags->nr_reserved_tags) <
+		tags->nr_tags - tags->nr_reserved_tags;
+}
+
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags, bool reserved)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait_exclusive(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+	if (!blk_mq_has_free_tags(tags, reserved))
+		io_schedule();
+	finish_wait(&tags->wait, &wait);
+}
+
+int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp, bool reserved)
+{
+	DEFINE_WAIT(wait);
+	int tag;
+
+	tag = __blk_mq_get_tag(tags, reserved);
+	if (tag >= 0 || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&tags->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags, reserved);
+		if (tag >= 0)
+			break;
+		io_schedule();
+	}
+	finish_wait(&tags->wait, &wait);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	if (tag < tags->nr_reserved_tags)
+		clear_bit(tag, tags->reserved_map);
+	else
+		clear_bit(tag - tags->nr_reserved_tags, tags->free_map);
+
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+/*
+ * Call @fn for every tag that is currently allocated.  The caller must
+ * cope with the tag being freed (and reused) while @fn runs.
+ */
+void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+			  void (*fn)(void *data, unsigned int tag), void *data)
+{
+	unsigned int depth = tags->nr_tags - tags->nr_reserved_tags;
+	unsigned int tag;
+
+	for_each_set_bit(tag, tags->reserved_map, tags->nr_reserved_tags)
+		fn(data, tag);
+
+	for_each_set_bit(tag, tags->free_map, depth)
+		fn(data, tag + tags->nr_reserved_tags);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
+				     unsigned int reserved_tags, int node)
+{
+	unsigned int nr_tags = total_tags - reserved_tags;
+	struct blk_mq_tags *tags;
+	unsigned int cpu;
+
+	if (total_tags > BLK_MQ_MAX_DEPTH || reserved_tags >= total_tags) {
+		printk(KERN_ERR "blk-mq: tag depth %u (reserved %u) invalid\n",
+		       total_tags, reserved_tags);
+		return NULL;
+	}
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->nr_tags = total_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->wait);
+
+	tags->free_map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				      GFP_KERNEL, node);
+	if (!tags->free_map)
+		goto err_free;
+
+	if (reserved_tags) {
+		tags->reserved_map = kzalloc_node(BITS_TO_LONGS(reserved_tags) *
+						  sizeof(long), GFP_KERNEL, node);
+		if (!tags->reserved_map)
+			goto err_free;
+	}
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint)
+		goto err_free;
+
+	/*
+	 * Spread the starting points of the CPUs over the map, so that
+	 * they don't all start out allocating from the same word.
+	 */
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(tags->hint, cpu) =
+			(cpu * BITS_PER_LONG) % nr_tags;
+
+	return tags;
+
+err_free:
+	kfree(tags->reserved_map);
+	kfree(tags->free_map);
+	kfree(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags->reserved_map);
+	kfree(tags->free_map);
+	kfree(tags);
+}
@@ -0,0 +1,1198 @@
+/*
+ * Block multiqueue core code
+ *
+ * Requests are staged on per-CPU software queues (struct blk_mq_ctx) and
+ * pulled from there by the hardware dispatch context (struct blk_mq_hw_ctx)
+ * they map onto.  Nothing on the submission or completion path takes the
+ * request_queue wide queue_lock, so submitters on different CPUs do not
+ * serialize against each other unless the driver makes them.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/list_sort.h>
+#include <linux/cpu.h>
+#include <linux/cache.h>
+#include <linux/sched.h>
+
+#include <trace/events/block.h>
+
+#include <linux/blk-mq.h>
+#include "blk.h"
+#include "blk-mq.h"
+
+static DEFINE_MUTEX(all_q_mutex);
+static LIST_HEAD(all_q_list);
+
+/*
+ * Check if any of the ctx's have pending work in this hardware queue
+ */
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < BITS_TO_LONGS(hctx->nr_ctx); i++)
+		if (hctx->ctx_map[i])
+			return true;
+
+	return false;
+}
+
+/*
+ * Mark this ctx as having pending work in this hardware queue
+ */
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static void blk_mq_rq_ctx_init(struct blk_mq_ctx *ctx, struct request *rq,
+			       unsigned int rw_flags)
+{
+	struct request_queue *q = ctx->queue;
+	int tag = rq->tag;
+
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+
+	if (blk_queue_io_stat(q))
+		rw_flags |= REQ_IO_STAT;
+	rq->cmd_flags = rw_flags;
+
+	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      struct blk_mq_ctx *ctx,
+					      unsigned int rw_flags,
+					      bool reserved)
+{
+	struct request *rq;
+	int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, GFP_ATOMIC, reserved);
+	if (tag < 0)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	rq->tag = tag;
+	blk_mq_rq_ctx_init(ctx, rq, rw_flags);
+
+	return rq;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request on a multiqueue device
+ * @q:		target request queue
+ * @rw:		request flags (direction, sync, ...)
+ * @gfp:	if __GFP_WAIT is set, sleep until a tag becomes available
+ * @reserved:	allocate from the reserved tag space
+ *
+ * The request is allocated from the hardware context that the current
+ * CPU maps to, and its software queue is recorded in ->mq_ctx.
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp, bool reserved)
+{
+	struct blk_mq_ctx *ctx;
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+
+	for (;;) {
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+		rq = __blk_mq_alloc_request(hctx, ctx, rw, reserved);
+		blk_mq_put_ctx(ctx);
+
+		if (rq || !(gfp & __GFP_WAIT))
+			break;
+
+		trace_block_sleeprq(q, NULL, rw & 1);
+		blk_mq_wait_for_tags(hctx->tags, reserved);
+	}
+
+	return rq;
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
+				  struct blk_mq_ctx *ctx, struct request *rq)
+{
+	const int tag = rq->tag;
+
+	ctx->rq_completed[rq_is_sync(rq)]++;
+	rq->atomic_flags = 0;
+
+	blk_mq_put_tag(hctx->tags, tag);
+}
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx;
+	struct request_queue *q = rq->q;
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	__blk_mq_free_request(hctx, ctx, rq);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end all I/O on a request and release it
+ * @rq:		the request to end
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Completes all bios attached to @rq, accounts the I/O and then either
+ *     hands the request to its ->end_io handler or frees it.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	/*
+	 * Completing the full byte count never leaves anything pending.
+	 */
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	if (unlikely(laptop_mode) && rq->cmd_type == REQ_TYPE_FS)
+		laptop_io_completion(&rq->q->backing_dev_info);
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_complete_request_local(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops->complete)
+		q->mq_ops->complete(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void __blk_mq_complete_request_remote(void *data)
+{
+	__blk_mq_complete_request_local(data);
+}
+
+/*
+ * Complete @rq on the CPU that submitted it, unless the completing CPU
+ * shares a cache with it anyway.  Returns false if the request has to be
+ * completed locally.
+ */
+static bool blk_mq_ipi_complete_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	int cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags))
+		return false;
+
+	cpu = smp_processor_id();
+	if (cpu == ctx->cpu || !cpu_online(ctx->cpu))
+		return false;
+
+	if (!test_bit(QUEUE_FLAG_SAME_FORCE, &q->queue_flags) &&
+	    blk_cpu_to_group(cpu) == blk_cpu_to_group(ctx->cpu))
+		return false;
+
+	rq->csd.func = __blk_mq_complete_request_remote;
+	rq->csd.info = rq;
+	rq->csd.flags = 0;
+	__smp_call_function_single(ctx->cpu, &rq->csd, 0);
+	return true;
+}
+#else
+static bool blk_mq_ipi_complete_request(struct request *rq)
+{
+	return false;
+}
+#endif
+
+static void __blk_mq_complete_request(struct request *rq)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	if (!blk_mq_ipi_complete_request(rq))
+		__blk_mq_complete_request_local(rq);
+	local_irq_restore(flags);
+}
+
+/**
+ * blk_mq_complete_request - end I/O on a request
+ * @rq:		the request being processed
+ *
+ * Description:
+ *     Ends all I/O on a request.  The driver's ->complete handler is run
+ *     on the CPU that submitted the request (or one sharing its cache),
+ *     without going through the block softirq.
+ **/
+void blk_mq_complete_request(struct request *rq)
+{
+	if (unlikely(blk_should_fake_timeout(rq->q)))
+		return;
+	if (!blk_mark_rq_complete(rq))
+		__blk_mq_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_add_timer(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	unsigned long expiry;
+
+	if (!rq->timeout)
+		rq->timeout = q->rq_timeout;
+
+	rq->deadline = jiffies + rq->timeout;
+
+	/*
+	 * The timer is shared by all hardware contexts, only move it if
+	 * this request expires before everything already pending.
+	 */
+	expiry = round_jiffies_up(rq->deadline);
+	if (!timer_pending(&q->timeout) ||
+	    time_before(expiry, q->timeout.expires))
+		mod_timer(&q->timeout, expiry);
+}
+
+static void blk_mq_start_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_issue(q, rq);
+
+	/*
+	 * We are now handing the request to the hardware, initialize
+	 * resid_len to full count and add the timeout handler.
+	 */
+	rq->resid_len = blk_rq_bytes(rq);
+	rq->cmd_flags |= REQ_STARTED;
+
+	if (q->mq_ops->timeout)
+		blk_mq_add_timer(rq);
+	set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+static void blk_mq_requeue_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_requeue(q, rq);
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	rq->cmd_flags &= ~REQ_END;
+}
+
+struct blk_mq_timeout_data {
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long next;
+	unsigned int next_set;
+};
+
+static void blk_mq_rq_timed_out(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	enum blk_eh_timer_return ret;
+
+	ret = q->mq_ops->timeout(rq);
+	switch (ret) {
+	case BLK_EH_HANDLED:
+		__blk_mq_complete_request(rq);
+		break;
+	case BLK_EH_RESET_TIMER:
+		blk_mq_add_timer(rq);
+		blk_clear_rq_complete(rq);
+		break;
+	case BLK_EH_NOT_HANDLED:
+		break;
+	default:
+		printk(KERN_ERR "block: bad eh return: %d\n", ret);
+		break;
+	}
+}
+
+static void blk_mq_timeout_check(void *__data, unsigned int tag)
+{
+	struct blk_mq_timeout_data *data = __data;
+	struct request *rq = data->hctx->rqs[tag];
+
+	if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
+		return;
+
+	if (time_after_eq(jiffies, rq->deadline)) {
+		/*
+		 * Check if we raced with end io completion
+		 */
+		if (!blk_mark_rq_complete(rq))
+			blk_mq_rq_timed_out(rq);
+	} else if (!data->next_set || time_after(data->next, rq->deadline)) {
+		data->next = rq->deadline;
+		data->next_set = 1;
+	}
+}
+
+static void blk_mq_rq_timer(unsigned long data)
+{
+	struct request_queue *q = (struct request_queue *) data;
+	struct blk_mq_timeout_data tdata = { .next_set = 0, };
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		tdata.hctx = hctx;
+		blk_mq_tag_busy_iter(hctx->tags, blk_mq_timeout_check, &tdata);
+	}
+
+	if (tdata.next_set)
+		mod_timer(&q->timeout, round_jiffies_up(tdata.next));
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit, queued;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock_irq(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock_irq(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	queued = 0;
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		/*
+		 * Let the driver batch doorbell writes: REQ_END marks the
+		 * last request we have to hand it in this run.
+		 */
+		if (list_empty(&rq_list))
+			rq->cmd_flags |= REQ_END;
+
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		switch (ret) {
+		case BLK_MQ_RQ_QUEUE_OK:
+			queued++;
+			continue;
+		case BLK_MQ_RQ_QUEUE_BUSY:
+			/*
+			 * FIXME: we should have a mechanism to stop the queue
+			 * like blk_stop_queue, otherwise we will waste cpu
+			 * time
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			blk_mq_requeue_request(rq);
+			break;
+		default:
+			printk(KERN_ERR "blk-mq: bad return on queue: %d\n", ret);
+			/* fall through */
+		case BLK_MQ_RQ_QUEUE_ERROR:
+			rq->errors = -EIO;
+			blk_mq_end_io(rq, rq->errors);
+			break;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY)
+			break;
+	}
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware context
+ * @hctx:	the hardware context to run
+ * @async:	defer the run to kblockd
+ *
+ * Must be called from process context unless @async is set.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->delayed_work,
+					      0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if ((!blk_mq_hctx_has_pending(hctx) &&
+		    list_empty_careful(&hctx->dispatch)) ||
+		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_stop_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/*
+ * ctx->lock must be held
+ */
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request for dispatch
+ * @rq:		the request
+ * @at_head:	insert at the head of the software queue
+ * @run_queue:	run the hardware queue after insertion
+ * @async:	run it from kblockd (required from atomic context)
+ */
+void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue,
+			   bool async)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long flags;
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	__blk_mq_insert_request(hctx, rq, at_head);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+static void blk_mq_insert_requests(struct request_queue *q,
+				   struct blk_mq_ctx *ctx,
+				   struct list_head *list,
+				   int depth,
+				   bool from_schedule)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	trace_block_unplug(q, depth, !from_schedule);
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	/*
+	 * preemption doesn't flush plug list, so it's possible ctx->cpu is
+	 * offline now
+	 */
+	spin_lock_irq(&ctx->lock);
+	while (!list_empty(list)) {
+		struct request *rq;
+
+		rq = list_first_entry(list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		__blk_mq_insert_request(hctx, rq, false);
+	}
+	spin_unlock_irq(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, from_schedule);
+}
+
+static int plug_ctx_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct request *rqa = container_of(a, struct request, queuelist);
+	struct request *rqb = container_of(b, struct request, queuelist);
+
+	return !(rqa->mq_ctx < rqb->mq_ctx ||
+		 (rqa->mq_ctx == rqb->mq_ctx &&
+		  blk_rq_pos(rqa) < blk_rq_pos(rqb)));
+}
+
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	struct blk_mq_ctx *this_ctx;
+	struct request_queue *this_q;
+	struct request *rq;
+	LIST_HEAD(list);
+	LIST_HEAD(ctx_list);
+	unsigned int depth;
+
+	list_splice_init(&plug->mq_list, &list);
+
+	list_sort(NULL, &list, plug_ctx_cmp);
+
+	this_q = NULL;
+	this_ctx = NULL;
+	depth = 0;
+
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		BUG_ON(!rq->q);
+		if (rq->mq_ctx != this_ctx) {
+			if (this_ctx) {
+				blk_mq_insert_requests(this_q, this_ctx,
+							&ctx_list, depth,
+							from_schedule);
+			}
+
+			this_ctx = rq->mq_ctx;
+			this_q = rq->q;
+			depth = 0;
+		}
+
+		depth++;
+		list_add_tail(&rq->queuelist, &ctx_list);
+	}
+
+	/*
+	 * If 'this_ctx' is set, we know we have entries to complete
+	 * on 'ctx_list'. Do those.
+	 */
+	if (this_ctx) {
+		blk_mq_insert_requests(this_q, this_ctx, &ctx_list, depth,
+				       from_schedule);
+	}
+}
+
+static void blk_mq_bio_to_request(struct request *rq, struct bio *bio)
+{
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+}
+
+/*
+ * Try to merge @bio into one of the most recently staged requests of the
+ * software queue.  ctx->lock must be held.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = 8;
+
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		el_ret = elv_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			if (bio_attempt_back_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			if (bio_attempt_front_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		}
+	}
+
+	return false;
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	const int is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	unsigned int rw_flags = bio_data_dir(bio);
+	unsigned int request_count = 0;
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct blk_plug *plug;
+	struct request *rq;
+
+	blk_queue_bounce(q, &bio);
+
+	if (!is_flush_fua &&
+	    blk_attempt_plug_merge(current, q, bio, &request_count))
+		return 0;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !is_flush_fua &&
+	    !blk_queue_nomerges(q)) {
+		bool merged;
+
+		spin_lock_irq(&ctx->lock);
+		merged = blk_mq_attempt_merge(q, ctx, bio);
+		spin_unlock_irq(&ctx->lock);
+
+		if (merged) {
+			blk_mq_put_ctx(ctx);
+			return 0;
+		}
+	}
+	blk_mq_put_ctx(ctx);
+
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags & 1);
+	rq = blk_mq_alloc_request(q, rw_flags, GFP_NOIO, false);
+
+	blk_mq_bio_to_request(rq, bio);
+
+	if (unlikely(is_flush_fua)) {
+		blk_mq_insert_flush(rq);
+		return 0;
+	}
+
+	/*
+	 * A task plug currently exists. Since this is completely lockless,
+	 * utilize that to temporarily store requests until the task is
+	 * either done or scheduled away.
+	 */
+	plug = current->plug;
+	if (plug) {
+		if (list_empty(&plug->mq_list))
+			trace_block_plug(q);
+		else if (request_count >= BLK_MAX_REQUEST_COUNT)
+			blk_flush_plug_list(plug, false);
+		list_add_tail(&rq->queuelist, &plug->mq_list);
+		return 0;
+	}
+
+	blk_mq_insert_request(rq, false, true, false);
+	return 0;
+}
+
+/*
+ * Default mapping to a software queue, since we use one per CPU.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+struct blk_mq_hw_ctx *blk_mq_alloc_single_hw_queue(struct blk_mq_reg *reg,
+						   unsigned int hctx_index)
+{
+	return kmalloc_node(sizeof(struct blk_mq_hw_ctx),
+				GFP_KERNEL | __GFP_ZERO, reg->numa_node);
+}
+EXPORT_SYMBOL(blk_mq_alloc_single_hw_queue);
+
+void blk_mq_free_single_hw_queue(struct blk_mq_hw_ctx *hctx,
+				 unsigned int hctx_index)
+{
+	kfree(hctx);
+}
+EXPORT_SYMBOL(blk_mq_free_single_hw_queue);
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      unsigned int reserved_tags, int node)
+{
+	size_t rq_size;
+	unsigned int i;
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, reserved_tags, node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	if (!hctx->rqs)
+		goto fail;
+
+	/*
+	 * Requests are preallocated together with the driver's per-command
+	 * data, which lives right behind them (see blk_mq_rq_to_pdu()).
+	 */
+	rq_size = round_up(sizeof(struct request) + hctx->cmd_size,
+			   cache_line_size());
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->rqs[i])
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	blk_mq_free_rq_map(hctx);
+	hctx->rqs = NULL;
+	hctx->tags = NULL;
+	return -ENOMEM;
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i, j;
+
+	/*
+	 * Initialize hardware queues
+	 */
+	queue_for_each_hw_ctx(q, hctx, i) {
+		unsigned int num_maps;
+		int node;
+
+		node = hctx->numa_node;
+		if (node == NUMA_NO_NODE)
+			node = hctx->numa_node = reg->numa_node;
+
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+		hctx->queue_depth = reg->queue_depth;
+		hctx->cmd_size = reg->cmd_size;
+
+		if (blk_mq_init_rq_map(hctx, reg->reserved_tags, node))
+			break;
+
+		/*
+		 * Allocate space for all possible cpus to avoid allocation in
+		 * runtime
+		 */
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+						GFP_KERNEL, node);
+		if (!hctx->ctxs)
+			break;
+
+		num_maps = ALIGN(nr_cpu_ids, BITS_PER_LONG) / BITS_PER_LONG;
+		hctx->ctx_map = kzalloc_node(num_maps * sizeof(unsigned long),
+						GFP_KERNEL, node);
+		if (!hctx->ctx_map)
+			break;
+
+		hctx->nr_ctx = 0;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			break;
+	}
+
+	if (i == q->nr_hw_queues)
+		return 0;
+
+	/*
+	 * Init failed
+	 */
+	queue_for_each_hw_ctx(q, hctx, j) {
+		if (i == j)
+			break;
+
+		if (reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, j);
+	}
+
+	queue_for_each_hw_ctx(q, hctx, j) {
+		blk_mq_free_rq_map(hctx);
+		hctx->rqs = NULL;
+		hctx->tags = NULL;
+		kfree(hctx->ctxs);
+		hctx->ctxs = NULL;
+		kfree(hctx->ctx_map);
+		hctx->ctx_map = NULL;
+	}
+
+	return 1;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q,
+				   unsigned int nr_hw_queues)
+{
+	unsigned int i;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
+		struct blk_mq_hw_ctx *hctx;
+
+		memset(__ctx, 0, sizeof(*__ctx));
+		__ctx->cpu = i;
+		spin_lock_init(&__ctx->lock);
+		INIT_LIST_HEAD(&__ctx->rq_list);
+		__ctx->queue = q;
+
+		/* If the cpu isn't online, the cpu is mapped to first hctx */
+		hctx = q->mq_ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+
+		/*
+		 * Set local node, IFF we have more than one hw queue. If
+		 * not, we remain on the home node of the device
+		 */
+		if (nr_hw_queues > 1 && hctx->numa_node == NUMA_NO_NODE)
+			hctx->numa_node = cpu_to_node(i);
+	}
+}
+
+static void blk_mq_map_swqueue(struct request_queue *q)
+{
+	unsigned int i;
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cpumask_clear(hctx->cpumask);
+		hctx->nr_ctx = 0;
+	}
+
+	/*
+	 * Map software to hardware queues
+	 */
+	for_each_possible_cpu(i) {
+		ctx = per_cpu_ptr(q->queue_ctx, i);
+		hctx = q->mq_ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multiqueue request queue
+ * @reg:	description of the hardware queues and driver callbacks
+ * @driver_data: passed to ->init_hctx() for each hardware context
+ *
+ * Returns the new queue, or an ERR_PTR() on failure.  The queue is torn
+ * down with blk_cleanup_queue() like any other.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx **hctxs;
+	struct blk_mq_ctx *ctx;
+	struct request_queue *q;
+	int i;
+
+	if (!reg->nr_hw_queues ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue ||
+	    !reg->ops->alloc_hctx || !reg->ops->free_hctx)
+		return ERR_PTR(-EINVAL);
+
+	if (!reg->queue_depth)
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		printk(KERN_ERR "blk-mq: queuedepth too large (%u)\n",
+		       reg->queue_depth);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	if (reg->queue_depth < (reg->reserved_tags + 1))
+		return ERR_PTR(-EINVAL);
+
+	ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	hctxs = kmalloc_node(reg->nr_hw_queues * sizeof(*hctxs),
+			     GFP_KERNEL | __GFP_ZERO, reg->numa_node);
+	if (!hctxs)
+		goto err_percpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = reg->ops->alloc_hctx(reg, i);
+		if (!hctxs[i])
+			goto err_hctxs;
+
+		if (!zalloc_cpumask_var(&hctxs[i]->cpumask, GFP_KERNEL))
+			goto err_hctxs;
+
+		hctxs[i]->numa_node = NUMA_NO_NODE;
+		hctxs[i]->queue_num = i;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		goto err_hctxs;
+
+	q->mq_map = blk_mq_make_queue_map(reg);
+	if (!q->mq_map)
+		goto err_map;
+
+	setup_timer(&q->timeout, blk_mq_rq_timer, (unsigned long) q);
+	blk_queue_rq_timeout(q, reg->timeout ? reg->timeout : 30 * HZ);
+
+	q->nr_queues = nr_cpu_ids;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	q->queue_ctx = ctx;
+	q->queue_hw_ctx = hctxs;
+
+	q->mq_ops = reg->ops;
+	q->queue_flags = QUEUE_FLAG_MQ_DEFAULT;
+
+	INIT_LIST_HEAD(&q->mq_flush_list);
+	spin_lock_init(&q->mq_flush_lock);
+	INIT_WORK(&q->mq_flush_work, blk_mq_flush_work);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+
+	q->sg_reserved_size = INT_MAX;
+
+	blk_mq_init_cpu_queues(q, reg->nr_hw_queues);
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err_hw;
+
+	blk_mq_map_swqueue(q);
+
+	mutex_lock(&all_q_mutex);
+	list_add_tail(&q->all_q_node, &all_q_list);
+	mutex_unlock(&all_q_mutex);
+
+	return q;
+err_hw:
+	kfree(q->mq_map);
+	q->mq_map = NULL;
+	q->mq_ops = NULL;
+err_map:
+	blk_cleanup_queue(q);
+err_hctxs:
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		if (!hctxs[i])
+			break;
+		free_cpumask_var(hctxs[i]->cpumask);
+		reg->ops->free_hctx(hctxs[i], i);
+	}
+	kfree(hctxs);
+err_percpu:
+	free_percpu(ctx);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Wait for everything that was dispatched from kblockd on behalf of this
+ * queue to finish.
+ */
+void blk_mq_sync_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	cancel_work_sync(&q->mq_flush_work);
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_delayed_work_sync(&hctx->delayed_work);
+}
+
+/*
+ * Called from blk_release_queue() when the last reference to @q is gone.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	mutex_lock(&all_q_mutex);
+	list_del_init(&q->all_q_node);
+	mutex_unlock(&all_q_mutex);
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->delayed_work);
+		kfree(hctx->ctx_map);
+		kfree(hctx->ctxs);
+		blk_mq_free_rq_map(hctx);
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		free_cpumask_var(hctx->cpumask);
+		q->mq_ops->free_hctx(hctx, i);
+	}
+
+	free_percpu(q->queue_ctx);
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+
+	q->queue_ctx = NULL;
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+}
+
+/*
+ * A CPU that goes away may still have requests staged on its software
+ * queue.  The queue itself stays around, so just make sure its hardware
+ * context runs once more and picks them up.  Offline CPUs are mapped to
+ * the first hardware queue when the queue map is built, and no new
+ * requests will be staged on this one until the CPU comes back.
+ */
+static void blk_mq_cpu_dead(struct request_queue *q, unsigned int cpu)
+{
+	struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, cpu);
+	bool pending;
+
+	spin_lock_irq(&ctx->lock);
+	pending = !list_empty(&ctx->rq_list);
+	if (pending)
+		blk_mq_hctx_mark_pending(hctx, ctx);
+	spin_unlock_irq(&ctx->lock);
+
+	if (pending)
+		blk_mq_run_hw_queue(hctx, true);
+}
+
+static int __cpuinit blk_mq_cpu_notify(struct notifier_block *nb,
+				       unsigned long action, void *hcpu)
+{
+	struct request_queue *q;
+
+	if (action != CPU_DEAD && action != CPU_DEAD_FROZEN)
+		return NOTIFY_OK;
+
+	mutex_lock(&all_q_mutex);
+	list_for_each_entry(q, &all_q_list, all_q_node)
+		blk_mq_cpu_dead(q, (unsigned long) hcpu);
+	mutex_unlock(&all_q_mutex);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __cpuinitdata blk_mq_cpu_notifier = {
+	.notifier_call	= blk_mq_cpu_notify,
+};
+
+static int __init blk_mq_init(void)
+{
+	register_hotcpu_notifier(&blk_mq_cpu_notifier);
+	return 0;
+}
+subsys_initcall(blk_mq_init);
@@ -20,6 +20,15 @@ void __blk_queue_free_tags(struct request_queue *q);
 bool __blk_end_bidi_request(struct request *rq, int error,
 			    unsigned int nr_bytes, unsigned int bidi_bytes);
 
+void drive_stat_acct(struct request *rq, int new_io);
+void blk_account_io_done(struct request *req);
+bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
+			    struct bio *bio);
+bool bio_attempt_front_merge(struct request_queue *q, struct request *req,
+			     struct bio *bio);
+bool blk_attempt_plug_merge(struct task_struct *tsk, struct request_queue *q,
+			    struct bio *bio, unsigned int *request_count);
+
 void blk_rq_timed_out_timer(unsigned long data);
 void blk_delete_timer(struct request *);
 void blk_add_timer(struct request *);
@@ -30,6 +39,7 @@ void __generic_unplug_device(struct request_queue *);
  */
 enum rq_atomic_flags {
 	REQ_ATOM_COMPLETE = 0,
+	REQ_ATOM_STARTED,
 };
 
 /*
@@ -53,6 +63,8 @@ static inline void blk_clear_rq_complete(struct request *rq)
 
 void blk_insert_flush(struct request *rq);
 void blk_abort_flushes(struct request_queue *q);
+void blk_mq_insert_flush(struct request *rq);
+void blk_mq_flush_work(struct work_struct *work);
 
 static inline struct request *__elv_next_request(struct request_queue *q)
 {
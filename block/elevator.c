@@ -62,6 +62,10 @@ static int elv_iosched_allow_merge(struct request *rq, struct bio *bio)
 	struct request_queue *q = rq->q;
 	struct elevator_queue *e = q->elevator;
 
+	/* multiqueue devices merge without an io scheduler */
+	if (!e)
+		return 1;
+
 	if (e->ops->elevator_allow_merge_fn)
 		return e->ops->elevator_allow_merge_fn(q, rq, bio);
 
@@ -582,7 +586,7 @@ void elv_bio_merged(struct request_queue *q, struct request *rq,
 {
 	struct elevator_queue *e = q->elevator;
 
-	if (e->ops->elevator_bio_merged_fn)
+	if (e && e->ops->elevator_bio_merged_fn)
 		e->ops->elevator_bio_merged_fn(q, rq, bio);
 }
 
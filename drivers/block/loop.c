@@ -54,6 +54,7 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/file.h>
+#include <linux/mount.h>
 #include <linux/stat.h>
 #include <linux/errno.h>
 #include <linux/major.h>
@@ -76,6 +77,9 @@
 #include <linux/splice.h>
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
+#include <linux/mempool.h>
+#include <linux/workqueue.h>
+#include <linux/aio.h>
 #include <asm/uaccess.h>
 
 static DEFINE_IDR(loop_index_idr);
@@ -498,6 +502,163 @@ out:
 	return ret;
 }
 
+/*
+ * Direct I/O mode (LO_FLAGS_DIRECT_IO).
+ *
+ * Instead of pushing every bio through loop_thread and the page cache of
+ * the backing file, bios are handed to loop_wq, whose workers read and
+ * write a second instance of the backing file, opened with O_DIRECT,
+ * straight from and into the pages of the bio.  Several bios are in
+ * flight at once, the filesystem does its own block mapping, locking and
+ * timestamp updates as for any O_DIRECT user, and the data is not cached
+ * a second time in the backing file's page cache.
+ *
+ * The iovecs passed down hold kernel addresses, flagged by
+ * KIF_KERNEL_PAGES, which only fs/direct-io.c knows about: so the mode is
+ * limited to block devices and to filesystems on one.
+ */
+struct loop_dio {
+	struct work_struct	work;
+	struct loop_device	*lo;
+	struct bio		*bio;
+	struct iovec		iov[BIO_MAX_PAGES];
+};
+
+#define LOOP_DIO_POOL_SIZE	16
+/* direct bios in flight per cpu */
+#define LOOP_DIO_MAX_ACTIVE	16
+
+static struct workqueue_struct *loop_wq;
+static mempool_t *loop_dio_pool;
+
+static int loop_open_dio_file(struct loop_device *lo)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	struct block_device *bdev;
+	struct file *dio_file;
+
+	bdev = S_ISBLK(inode->i_mode) ? I_BDEV(inode) : inode->i_sb->s_bdev;
+	if (!bdev || !file->f_mapping->a_ops->direct_IO ||
+	    !file->f_op->aio_read || !file->f_op->aio_write)
+		return -EINVAL;
+	/* every sector of the loop device must be aligned for O_DIRECT */
+	if (bdev_logical_block_size(bdev) > 512)
+		return -EINVAL;
+
+	dio_file = dentry_open(dget(file->f_path.dentry),
+			       mntget(file->f_path.mnt),
+			       (file->f_flags & ~(O_CREAT | O_EXCL | O_TRUNC)) |
+			       O_DIRECT, current_cred());
+	if (IS_ERR(dio_file))
+		return PTR_ERR(dio_file);
+	lo->lo_dio_file = dio_file;
+	return 0;
+}
+
+static void loop_put_dio_file(struct loop_device *lo)
+{
+	if (lo->lo_dio_file) {
+		fput(lo->lo_dio_file);
+		lo->lo_dio_file = NULL;
+	}
+}
+
+static int loop_dio_rw(struct loop_device *lo, struct bio *bio,
+		       struct iovec *iov)
+{
+	struct file *file = lo->lo_dio_file;
+	loff_t pos = ((loff_t) bio->bi_sector << 9) + lo->lo_offset;
+	struct bio_vec *bvec;
+	struct kiocb kiocb;
+	mm_segment_t old_fs;
+	unsigned long nr = 0;
+	ssize_t ret;
+	int i;
+
+	bio_for_each_segment(bvec, bio, i) {
+		iov[nr].iov_base = page_address(bvec->bv_page) +
+				   bvec->bv_offset;
+		iov[nr].iov_len = bvec->bv_len;
+		nr++;
+	}
+
+	init_sync_kiocb(&kiocb, file);
+	kiocb.ki_pos = pos;
+	kiocb.ki_left = bio->bi_size;
+	kiocb.ki_nbytes = bio->bi_size;
+	set_bit(KIF_KERNEL_PAGES, &kiocb.ki_flags);
+
+	old_fs = get_fs();
+	set_fs(get_ds());
+	if (bio_rw(bio) == WRITE)
+		ret = file->f_op->aio_write(&kiocb, iov, nr, pos);
+	else
+		ret = file->f_op->aio_read(&kiocb, iov, nr, pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	set_fs(old_fs);
+
+	if (ret == bio->bi_size)
+		return 0;
+	return ret < 0 ? ret : -EIO;
+}
+
+static void loop_dio_work(struct work_struct *work)
+{
+	struct loop_dio *dio = container_of(work, struct loop_dio, work);
+	struct loop_device *lo = dio->lo;
+	struct bio *bio = dio->bio;
+	int ret = 0;
+
+	/* page_address() must work on every page of the bio */
+	blk_queue_bounce(lo->lo_queue, &bio);
+
+	if (bio->bi_rw & REQ_DISCARD) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
+	if (bio->bi_rw & REQ_FLUSH) {
+		ret = vfs_fsync(lo->lo_dio_file, 0);
+		if (unlikely(ret && ret != -EINVAL)) {
+			ret = -EIO;
+			goto out;
+		}
+		ret = 0;
+	}
+
+	if (bio->bi_size)
+		ret = loop_dio_rw(lo, bio, dio->iov);
+
+	if ((bio->bi_rw & REQ_FUA) && !ret) {
+		ret = vfs_fsync(lo->lo_dio_file, 0);
+		if (unlikely(ret && ret != -EINVAL))
+			ret = -EIO;
+		else
+			ret = 0;
+	}
+out:
+	bio_endio(bio, ret);
+	mempool_free(dio, loop_dio_pool);
+	if (atomic_dec_and_test(&lo->lo_dio_inflight))
+		wake_up(&lo->lo_dio_wait);
+}
+
+/*
+ * Hand @bio over to loop_wq.  The caller has accounted the bio in
+ * lo_dio_inflight.
+ */
+static void loop_queue_dio(struct loop_device *lo, struct bio *bio)
+{
+	struct loop_dio *dio = mempool_alloc(loop_dio_pool, GFP_NOIO);
+
+	INIT_WORK(&dio->work, loop_dio_work);
+	dio->lo = lo;
+	dio->bio = bio;
+	queue_work(loop_wq, &dio->work);
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -529,6 +690,12 @@ static int loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) && old_bio->bi_bdev) {
+		atomic_inc(&lo->lo_dio_inflight);
+		spin_unlock_irq(&lo->lo_lock);
+		loop_queue_dio(lo, old_bio);
+		return 0;
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -542,6 +709,7 @@ out:
 
 struct switch_request {
 	struct file *file;
+	bool direct_io;
 	struct completion wait;
 };
 
@@ -552,6 +720,10 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 	if (unlikely(!bio->bi_bdev)) {
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
+	} else if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		/* queued behind the switch to direct I/O */
+		atomic_inc(&lo->lo_dio_inflight);
+		loop_queue_dio(lo, bio);
 	} else {
 		int ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
@@ -601,7 +773,8 @@ static int loop_thread(void *data)
  * First it needs to flush existing IO, it does this by sending a magic
  * BIO down the pipe. The completion of this BIO does the actual switch.
  */
-static int loop_switch(struct loop_device *lo, struct file *file)
+static int __loop_switch(struct loop_device *lo, struct file *file,
+			 bool direct_io)
 {
 	struct switch_request w;
 	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
@@ -609,6 +782,7 @@ static int loop_switch(struct loop_device *lo, struct file *file)
 		return -ENOMEM;
 	init_completion(&w.wait);
 	w.file = file;
+	w.direct_io = direct_io;
 	bio->bi_private = &w;
 	bio->bi_bdev = NULL;
 	loop_make_request(lo->lo_queue, bio);
@@ -616,6 +790,41 @@ static int loop_switch(struct loop_device *lo, struct file *file)
 	return 0;
 }
 
+static int loop_switch(struct loop_device *lo, struct file *file)
+{
+	return __loop_switch(lo, file,
+			     (lo->lo_flags & LO_FLAGS_DIRECT_IO) != 0);
+}
+
+/*
+ * Switch between buffered and direct I/O.  The change itself is made by
+ * loop_thread (see do_loop_switch_dio()), after every bio queued before it
+ * has been handled.
+ */
+static int loop_set_direct_io(struct loop_device *lo, bool direct_io)
+{
+	int err;
+
+	if (!direct_io) {
+		err = __loop_switch(lo, NULL, false);
+		if (!err)
+			loop_put_dio_file(lo);
+		return err;
+	}
+
+	if (lo->transfer != transfer_none || (lo->lo_offset & 511))
+		return -EINVAL;
+
+	err = loop_open_dio_file(lo);
+	if (err)
+		return err;
+
+	err = __loop_switch(lo, NULL, true);
+	if (err)
+		loop_put_dio_file(lo);
+	return err;
+}
+
 /*
  * Helper to flush the IOs in loop, but keeping loop thread running
  */
@@ -628,6 +837,28 @@ static int loop_flush(struct loop_device *lo)
 	return loop_switch(lo, NULL);
 }
 
+/*
+ * Runs in loop_thread, so no buffered bio is in progress.  Going back to
+ * buffered, wait for direct bios in flight.  The page cache of the file
+ * is kept coherent by the filesystem's O_DIRECT path in either direction.
+ */
+static void do_loop_switch_dio(struct loop_device *lo, bool direct_io)
+{
+	if (direct_io == ((lo->lo_flags & LO_FLAGS_DIRECT_IO) != 0))
+		return;
+
+	spin_lock_irq(&lo->lo_lock);
+	if (direct_io)
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	else
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	spin_unlock_irq(&lo->lo_lock);
+
+	if (!direct_io)
+		wait_event(lo->lo_dio_wait,
+			   !atomic_read(&lo->lo_dio_inflight));
+}
+
 /*
  * Do the actual switch; called from the BIO completion routine
  */
@@ -649,6 +880,7 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 out:
+	do_loop_switch_dio(lo, p->direct_io);
 	complete(&p->wait);
 }
 
@@ -677,6 +909,11 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY))
 		goto out;
 
+	/* lo_dio_file is the old file opened O_DIRECT */
+	error = -EBUSY;
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+		goto out;
+
 	error = -EBADF;
 	file = fget(arg);
 	if (!file)
@@ -777,16 +1014,25 @@ static ssize_t loop_attr_autoclear_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", autoclear ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
 	&loop_attr_offset.attr,
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -1000,6 +1246,9 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 
 	kthread_stop(lo->lo_thread);
 
+	wait_event(lo->lo_dio_wait, !atomic_read(&lo->lo_dio_inflight));
+	loop_put_dio_file(lo);
+
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
 	spin_unlock_irq(&lo->lo_lock);
@@ -1058,6 +1307,10 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		return -ENXIO;
 	if ((unsigned int) info->lo_encrypt_key_size > LO_KEY_SIZE)
 		return -EINVAL;
+	/* direct I/O bypasses the transfer functions */
+	if ((info->lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    (info->lo_encrypt_type || (info->lo_offset & 511)))
+		return -EINVAL;
 
 	err = loop_release_xfer(lo);
 	if (err)
@@ -1100,6 +1353,14 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	     (info->lo_flags & LO_FLAGS_AUTOCLEAR))
 		lo->lo_flags ^= LO_FLAGS_AUTOCLEAR;
 
+	if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) !=
+	     (info->lo_flags & LO_FLAGS_DIRECT_IO)) {
+		err = loop_set_direct_io(lo,
+				(info->lo_flags & LO_FLAGS_DIRECT_IO) != 0);
+		if (err)
+			return err;
+	}
+
 	lo->lo_encrypt_key_size = info->lo_encrypt_key_size;
 	lo->lo_init[0] = info->lo_init[0];
 	lo->lo_init[1] = info->lo_init[1];
@@ -1639,6 +1900,8 @@ static int loop_add(struct loop_device **l, int i)
 	lo->lo_number		= i;
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
+	init_waitqueue_head(&lo->lo_dio_wait);
+	atomic_set(&lo->lo_dio_inflight, 0);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
@@ -1836,8 +2099,22 @@ static int __init loop_init(void)
 		range = 1UL << MINORBITS;
 	}
 
-	if (register_blkdev(LOOP_MAJOR, "loop"))
+	loop_wq = alloc_workqueue("kloopd", WQ_MEM_RECLAIM,
+				  LOOP_DIO_MAX_ACTIVE);
+	if (!loop_wq)
+		return -ENOMEM;
+	loop_dio_pool = mempool_create_kmalloc_pool(LOOP_DIO_POOL_SIZE,
+						    sizeof(struct loop_dio));
+	if (!loop_dio_pool) {
+		destroy_workqueue(loop_wq);
+		return -ENOMEM;
+	}
+
+	if (register_blkdev(LOOP_MAJOR, "loop")) {
+		mempool_destroy(loop_dio_pool);
+		destroy_workqueue(loop_wq);
 		return -EIO;
+	}
 
 	blk_register_region(MKDEV(LOOP_MAJOR, 0), range,
 				  THIS_MODULE, loop_probe, NULL, NULL);
@@ -1874,6 +2151,9 @@ static void __exit loop_exit(void)
 	unregister_blkdev(LOOP_MAJOR, "loop");
 
 	misc_deregister(&loop_misc);
+
+	mempool_destroy(loop_dio_pool);
+	destroy_workqueue(loop_wq);
 }
 
 module_init(loop_init);
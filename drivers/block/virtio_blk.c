@@ -2,6 +2,7 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/hdreg.h>
 #include <linux/virtio.h>
 #include <linux/virtio_blk.h>
@@ -14,6 +15,10 @@
 static int major, index;
 struct workqueue_struct *virtblk_wq;
 
+static unsigned int virtblk_queue_depth = 64;
+module_param_named(queue_depth, virtblk_queue_depth, uint, 0444);
+MODULE_PARM_DESC(queue_depth, "Number of requests each virtio-blk device can have in flight");
+
 struct virtio_blk
 {
 	spinlock_t lock;
@@ -24,30 +29,59 @@ struct virtio_blk
 	/* The disk structure for the kernel. */
 	struct gendisk *disk;
 
-	/* Request tracking. */
-	struct list_head reqs;
-
-	mempool_t *pool;
-
 	/* Process context for config space updates */
 	struct work_struct config_work;
 
 	/* What host tells us, plus 2 for header & tailer. */
 	unsigned int sg_elems;
-
-	/* Scatterlist: can be too big for stack. */
-	struct scatterlist sg[/*sg_elems*/];
 };
 
+/*
+ * Lives in the per-request payload that blk-mq allocates behind each
+ * struct request, so there is nothing to allocate in the IO path.
+ */
 struct virtblk_req
 {
-	struct list_head list;
 	struct request *req;
 	struct virtio_blk_outhdr out_hdr;
 	struct virtio_scsi_inhdr in_hdr;
 	u8 status;
+	struct scatterlist sg[/*sg_elems*/];
 };
 
+static inline int virtblk_result(struct virtblk_req *vbr)
+{
+	switch (vbr->status) {
+	case VIRTIO_BLK_S_OK:
+		return 0;
+	case VIRTIO_BLK_S_UNSUPP:
+		return -ENOTTY;
+	default:
+		return -EIO;
+	}
+}
+
+static void virtblk_request_done(struct request *req)
+{
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
+	int error = virtblk_result(vbr);
+
+	switch (req->cmd_type) {
+	case REQ_TYPE_BLOCK_PC:
+		req->resid_len = vbr->in_hdr.residual;
+		req->sense_len = vbr->in_hdr.sense_len;
+		req->errors = vbr->in_hdr.errors;
+		break;
+	case REQ_TYPE_SPECIAL:
+		req->errors = (error != 0);
+		break;
+	default:
+		break;
+	}
+
+	blk_mq_end_io(req, error);
+}
+
 static void blk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
@@ -56,53 +90,23 @@ static void blk_done(struct virtqueue *vq)
 	unsigned long flags;
 
 	spin_lock_irqsave(&vblk->lock, flags);
-	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
-		int error;
-
-		switch (vbr->status) {
-		case VIRTIO_BLK_S_OK:
-			error = 0;
-			break;
-		case VIRTIO_BLK_S_UNSUPP:
-			error = -ENOTTY;
-			break;
-		default:
-			error = -EIO;
-			break;
-		}
-
-		switch (vbr->req->cmd_type) {
-		case REQ_TYPE_BLOCK_PC:
-			vbr->req->resid_len = vbr->in_hdr.residual;
-			vbr->req->sense_len = vbr->in_hdr.sense_len;
-			vbr->req->errors = vbr->in_hdr.errors;
-			break;
-		case REQ_TYPE_SPECIAL:
-			vbr->req->errors = (error != 0);
-			break;
-		default:
-			break;
-		}
+	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL)
+		blk_mq_complete_request(vbr->req);
+	spin_unlock_irqrestore(&vblk->lock, flags);
 
-		__blk_end_request_all(vbr->req, error);
-		list_del(&vbr->list);
-		mempool_free(vbr, vblk->pool);
-	}
 	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
-	spin_unlock_irqrestore(&vblk->lock, flags);
+	blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
 }
 
-static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
 {
-	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
+	unsigned long flags;
+	unsigned int num, out = 0, in = 0;
+	const bool last = (req->cmd_flags & REQ_END) != 0;
 
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
+	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
 
 	vbr->req = req;
 
@@ -133,7 +137,7 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	sg_set_buf(&vblk->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
+	sg_set_buf(&vbr->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
 
 	/*
 	 * If this is a packet command we need a couple of additional headers.
@@ -142,17 +146,17 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 	 * inhdr with additional status information before the normal inhdr.
 	 */
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC)
-		sg_set_buf(&vblk->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
+		sg_set_buf(&vbr->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
 
-	num = blk_rq_map_sg(q, vbr->req, vblk->sg + out);
+	num = blk_rq_map_sg(hctx->queue, vbr->req, vbr->sg + out);
 
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC) {
-		sg_set_buf(&vblk->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
-		sg_set_buf(&vblk->sg[num + out + in++], &vbr->in_hdr,
+		sg_set_buf(&vbr->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
+		sg_set_buf(&vbr->sg[num + out + in++], &vbr->in_hdr,
 			   sizeof(vbr->in_hdr));
 	}
 
-	sg_set_buf(&vblk->sg[num + out + in++], &vbr->status,
+	sg_set_buf(&vbr->sg[num + out + in++], &vbr->status,
 		   sizeof(vbr->status));
 
 	if (num) {
@@ -165,38 +169,55 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0) {
-		mempool_free(vbr, vblk->pool);
-		return false;
+	spin_lock_irqsave(&vblk->lock, flags);
+	if (virtqueue_add_buf(vblk->vq, vbr->sg, out, in, vbr) < 0) {
+		/*
+		 * The ring is full.  Push out what we have, and stop the
+		 * queue under the lock so that blk_done() can't miss
+		 * restarting it.
+		 */
+		virtqueue_kick(vblk->vq);
+		blk_mq_stop_hw_queue(hctx);
+		spin_unlock_irqrestore(&vblk->lock, flags);
+		return BLK_MQ_RQ_QUEUE_BUSY;
 	}
 
-	list_add_tail(&vbr->list, &vblk->reqs);
-	return true;
+	/* Only notify the host once per batch of requests. */
+	if (last)
+		virtqueue_kick(vblk->vq);
+
+	spin_unlock_irqrestore(&vblk->lock, flags);
+	return BLK_MQ_RQ_QUEUE_OK;
 }
 
-static void do_virtblk_request(struct request_queue *q)
+static int virtblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			     unsigned int index)
 {
-	struct virtio_blk *vblk = q->queuedata;
-	struct request *req;
-	unsigned int issued = 0;
+	struct virtio_blk *vblk = data;
+	unsigned int i;
 
-	while ((req = blk_peek_request(q)) != NULL) {
-		BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+	/*
+	 * blk_rq_map_sg() copes with stale end markers, so the scatterlists
+	 * only have to be set up once rather than for every request.
+	 */
+	for (i = 0; i < hctx->queue_depth; i++) {
+		struct virtblk_req *vbr = blk_mq_rq_to_pdu(hctx->rqs[i]);
 
-		/* If this request fails, stop queue and wait for something to
-		   finish to restart it. */
-		if (!do_req(q, vblk, req)) {
-			blk_stop_queue(q);
-			break;
-		}
-		blk_start_request(req);
-		issued++;
+		sg_init_table(vbr->sg, vblk->sg_elems);
 	}
 
-	if (issued)
-		virtqueue_kick(vblk->vq);
+	return 0;
 }
 
+static struct blk_mq_ops virtio_mq_ops = {
+	.queue_rq	= virtio_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.complete	= virtblk_request_done,
+	.alloc_hctx	= blk_mq_alloc_single_hw_queue,
+	.free_hctx	= blk_mq_free_single_hw_queue,
+	.init_hctx	= virtblk_init_hctx,
+};
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -340,6 +361,7 @@ static void virtblk_config_changed(struct virtio_device *vdev)
 static int __devinit virtblk_probe(struct virtio_device *vdev)
 {
 	struct virtio_blk *vblk;
+	struct blk_mq_reg reg;
 	struct request_queue *q;
 	int err;
 	u64 cap;
@@ -361,18 +383,15 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	/* We need an extra sg elements at head and tail. */
 	sg_elems += 2;
-	vdev->priv = vblk = kmalloc(sizeof(*vblk) +
-				    sizeof(vblk->sg[0]) * sg_elems, GFP_KERNEL);
+	vdev->priv = vblk = kmalloc(sizeof(*vblk), GFP_KERNEL);
 	if (!vblk) {
 		err = -ENOMEM;
 		goto out;
 	}
 
-	INIT_LIST_HEAD(&vblk->reqs);
 	spin_lock_init(&vblk->lock);
 	vblk->vdev = vdev;
 	vblk->sg_elems = sg_elems;
-	sg_init_table(vblk->sg, vblk->sg_elems);
 	INIT_WORK(&vblk->config_work, virtblk_config_changed_work);
 
 	/* We expect one virtqueue, for output. */
@@ -382,22 +401,25 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 		goto out_free_vblk;
 	}
 
-	vblk->pool = mempool_create_kmalloc_pool(1,sizeof(struct virtblk_req));
-	if (!vblk->pool) {
-		err = -ENOMEM;
-		goto out_free_vq;
-	}
-
 	/* FIXME: How many partitions?  How long is a piece of string? */
 	vblk->disk = alloc_disk(1 << PART_BITS);
 	if (!vblk->disk) {
 		err = -ENOMEM;
-		goto out_mempool;
+		goto out_free_vq;
 	}
 
-	q = vblk->disk->queue = blk_init_queue(do_virtblk_request, &vblk->lock);
-	if (!q) {
-		err = -ENOMEM;
+	memset(&reg, 0, sizeof(reg));
+	reg.ops = &virtio_mq_ops;
+	reg.nr_hw_queues = 1;
+	reg.queue_depth = virtblk_queue_depth;
+	reg.cmd_size = sizeof(struct virtblk_req) +
+			sizeof(struct scatterlist) * sg_elems;
+	reg.numa_node = NUMA_NO_NODE;
+	reg.flags = BLK_MQ_F_SHOULD_MERGE;
+
+	q = vblk->disk->queue = blk_mq_init_queue(&reg, vblk);
+	if (IS_ERR(q)) {
+		err = PTR_ERR(q);
 		goto out_put_disk;
 	}
 
@@ -510,8 +532,6 @@ out_del_disk:
 	blk_cleanup_queue(vblk->disk->queue);
 out_put_disk:
 	put_disk(vblk->disk);
-out_mempool:
-	mempool_destroy(vblk->pool);
 out_free_vq:
 	vdev->config->del_vqs(vdev);
 out_free_vblk:
@@ -526,16 +546,12 @@ static void __devexit virtblk_remove(struct virtio_device *vdev)
 
 	flush_work(&vblk->config_work);
 
-	/* Nothing should be pending. */
-	BUG_ON(!list_empty(&vblk->reqs));
-
 	/* Stop all the virtqueues. */
 	vdev->config->reset(vdev);
 
 	del_gendisk(vblk->disk);
 	blk_cleanup_queue(vblk->disk->queue);
 	put_disk(vblk->disk);
-	mempool_destroy(vblk->pool);
 	vdev->config->del_vqs(vdev);
 	kfree(vblk);
 }
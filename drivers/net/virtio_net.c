@@ -26,6 +26,7 @@
 #include <linux/scatterlist.h>
 #include <linux/if_vlan.h>
 #include <linux/slab.h>
+#include <linux/interrupt.h>
 
 static int napi_weight = 128;
 module_param(napi_weight, int, 0444);
@@ -71,6 +72,12 @@ struct virtnet_info {
 	/* Work struct for refilling if we run low on memory. */
 	struct delayed_work refill;
 
+	/* Reaps transmitted skbs when the host signals completions. */
+	struct tasklet_struct xmit_tasklet;
+
+	/* Room left in svq after the last xmit, plus what was reaped since. */
+	unsigned int tx_capacity;
+
 	/* Chain pages by the private ptr. */
 	struct page *pages;
 
@@ -136,8 +143,12 @@ static void skb_xmit_done(struct virtqueue *svq)
 	/* Suppress further interrupts. */
 	virtqueue_disable_cb(svq);
 
-	/* We were probably waiting for more output buffers. */
-	netif_wake_queue(vi->dev);
+	/*
+	 * The queue may have been stopped by the byte queue limit rather
+	 * than by us, in which case only reaping the completions (and
+	 * reporting them) gets it going again.
+	 */
+	tasklet_schedule(&vi->xmit_tasklet);
 }
 
 static void set_skb_frag(struct sk_buff *skb, struct page *page,
@@ -527,10 +538,12 @@ again:
 	return received;
 }
 
+/* Must be called with the tx lock held. */
 static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
 {
 	struct sk_buff *skb;
 	unsigned int len, tot_sgs = 0;
+	unsigned int pkts = 0, bytes = 0;
 	struct virtnet_stats __percpu *stats = this_cpu_ptr(vi->stats);
 
 	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
@@ -541,12 +554,45 @@ static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
 		stats->tx_packets++;
 		u64_stats_update_end(&stats->syncp);
 
+		pkts++;
+		bytes += skb->len;
 		tot_sgs += skb_vnet_hdr(skb)->num_sg;
 		dev_kfree_skb_any(skb);
 	}
+
+	netdev_completed_queue(vi->dev, pkts, bytes);
 	return tot_sgs;
 }
 
+static void xmit_tasklet(unsigned long data)
+{
+	struct virtnet_info *vi = (struct virtnet_info *)data;
+	struct netdev_queue *txq = netdev_get_tx_queue(vi->dev, 0);
+
+	__netif_tx_lock(txq, smp_processor_id());
+	vi->tx_capacity += free_old_xmit_skbs(vi);
+
+	/* We were probably waiting for more output buffers. */
+	if (vi->tx_capacity >= 2+MAX_SKB_FRAGS)
+		netif_wake_queue(vi->dev);
+
+	/*
+	 * skb_xmit_done() disabled the callback: while the queue stays
+	 * stopped, by a full ring or by the byte queue limit, it must be
+	 * armed again, or no completion will ever restart the queue.
+	 */
+	while (netif_xmit_stopped(txq) &&
+	       unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
+		/* More just got used, free them then recheck. */
+		vi->tx_capacity += free_old_xmit_skbs(vi);
+		if (vi->tx_capacity >= 2+MAX_SKB_FRAGS)
+			netif_wake_queue(vi->dev);
+		if (!netif_xmit_stopped(txq))
+			virtqueue_disable_cb(vi->svq);
+	}
+	__netif_tx_unlock(txq);
+}
+
 static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 {
 	struct skb_vnet_hdr *hdr = skb_vnet_hdr(skb);
@@ -597,6 +643,7 @@ static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, 0);
 	int capacity;
 
 	/* Free up any pending old buffers before queueing new ones. */
@@ -623,6 +670,7 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		return NETDEV_TX_OK;
 	}
 	virtqueue_kick(vi->svq);
+	netdev_tx_sent_queue(txq, skb->len);
 
 	/* Don't wait up for transmitted skbs to be freed. */
 	skb_orphan(skb);
@@ -640,7 +688,19 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 				virtqueue_disable_cb(vi->svq);
 			}
 		}
+	} else if (unlikely(netif_xmit_stopped(txq))) {
+		/* Over the byte queue limit: we need to hear about
+		 * completions to restart, so keep the callback armed
+		 * until some are pending or the limit has been lifted. */
+		while (unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
+			capacity += free_old_xmit_skbs(vi);
+			if (!netif_xmit_stopped(txq)) {
+				virtqueue_disable_cb(vi->svq);
+				break;
+			}
+		}
 	}
+	vi->tx_capacity = capacity;
 
 	return NETDEV_TX_OK;
 }
@@ -1002,6 +1062,7 @@ static int virtnet_probe(struct virtio_device *vdev)
 		goto free;
 
 	INIT_DELAYED_WORK(&vi->refill, refill_work);
+	tasklet_init(&vi->xmit_tasklet, xmit_tasklet, (unsigned long)vi);
 	sg_init_table(vi->rx_sg, ARRAY_SIZE(vi->rx_sg));
 	sg_init_table(vi->tx_sg, ARRAY_SIZE(vi->tx_sg));
 
@@ -1104,6 +1165,7 @@ static void __devexit virtnet_remove(struct virtio_device *vdev)
 
 	unregister_netdev(vi->dev);
 	cancel_delayed_work_sync(&vi->refill);
+	tasklet_kill(&vi->xmit_tasklet);
 
 	/* Free unused buffers in both send and recv, if any. */
 	free_unused_bufs(vi);
@@ -1277,13 +1277,46 @@ static void pohmelfs_flush_transactions(struct pohmelfs_sb *psb)
  * ->put_super() callback. Invoked before superblock is destroyed,
  *  so it has to clean all private data.
  */
+/*
+ * Drop the references of inodes on one of the per-cpu sb inode lists.
+ */
+static void pohmelfs_put_inode_list(struct list_head *list)
+{
+	struct pohmelfs_inode *pi;
+	struct inode *inode, *tmp;
+	unsigned int count;
+
+	list_for_each_entry_safe(inode, tmp, list, i_sb_list) {
+		pi = POHMELFS_I(inode);
+
+		dprintk("%s: ino: %llu, pi: %p, inode: %p, i_count: %u.\n",
+				__func__, pi->ino, pi, inode, atomic_read(&inode->i_count));
+
+		/*
+		 * These are special inodes, they were created during
+		 * directory reading or lookup, and were not bound to dentry,
+		 * so they live here with reference counter being 1 and prevent
+		 * umount from succeed since it believes that they are busy.
+		 */
+		count = atomic_read(&inode->i_count);
+		if (count) {
+			list_del_init(&inode->i_sb_list);
+			while (count--)
+				iput(&pi->vfs_inode);
+		}
+	}
+}
+
 static void pohmelfs_put_super(struct super_block *sb)
 {
 	struct pohmelfs_sb *psb = POHMELFS_SB(sb);
 	struct pohmelfs_inode *pi;
 	unsigned int count = 0;
 	unsigned int in_drop_list = 0;
-	struct inode *inode, *tmp;
+	struct inode *inode;
+#ifdef CONFIG_SMP
+	int cpu;
+#endif
 
 	dprintk("%s.\n", __func__);
 
@@ -1310,25 +1343,12 @@ static void pohmelfs_put_super(struct super_block *sb)
 			iput(&pi->vfs_inode);
 	}
 
-	list_for_each_entry_safe(inode, tmp, &sb->s_inodes, i_sb_list) {
-		pi = POHMELFS_I(inode);
-
-		dprintk("%s: ino: %llu, pi: %p, inode: %p, i_count: %u.\n",
-				__func__, pi->ino, pi, inode, atomic_read(&inode->i_count));
-
-		/*
-		 * These are special inodes, they were created during
-		 * directory reading or lookup, and were not bound to dentry,
-		 * so they live here with reference counter being 1 and prevent
-		 * umount from succeed since it believes that they are busy.
-		 */
-		count = atomic_read(&inode->i_count);
-		if (count) {
-			list_del_init(&inode->i_sb_list);
-			while (count--)
-				iput(&pi->vfs_inode);
-		}
-	}
+#ifdef CONFIG_SMP
+	for_each_possible_cpu(cpu)
+		pohmelfs_put_inode_list(per_cpu_ptr(sb->s_inodes, cpu));
+#else
+	pohmelfs_put_inode_list(&sb->s_inodes);
+#endif
 
 	psb->trans_scan_timeout = psb->drop_scan_timeout = 0;
 	cancel_delayed_work_sync(&psb->dwork);
@@ -42,16 +42,6 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
-{
-	*v = *v + 1;
-}
-
-static void zram_stat_dec(u32 *v)
-{
-	*v = *v - 1;
-}
-
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
 {
 	spin_lock(&zram->stat64_lock);
@@ -104,6 +94,108 @@ static int page_zero_filled(void *ptr)
 	return 1;
 }
 
+static struct zram_strm *zram_strm_alloc(gfp_t flags)
+{
+	struct zram_strm *strm;
+
+	strm = kmalloc(sizeof(*strm), flags);
+	if (!strm)
+		return NULL;
+
+	strm->workmem = kzalloc(LZO1X_MEM_COMPRESS, flags);
+	strm->buffer = (void *)__get_free_pages(flags | __GFP_ZERO, 1);
+	if (!strm->workmem || !strm->buffer) {
+		kfree(strm->workmem);
+		free_pages((unsigned long)strm->buffer, 1);
+		kfree(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+static void zram_strm_free(struct zram_strm *strm)
+{
+	kfree(strm->workmem);
+	free_pages((unsigned long)strm->buffer, 1);
+	kfree(strm);
+}
+
+/*
+ * Get an idle compression stream, allocating a new one if fewer than
+ * max_strm exist.  Otherwise (or if that allocation fails) wait for one to
+ * be released: zram_init_device() always creates the first stream.
+ */
+static struct zram_strm *zram_strm_get(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			strm = list_first_entry(&zram->idle_strm,
+						struct zram_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&zram->strm_lock);
+			return strm;
+		}
+
+		if (zram->avail_strm >= zram->max_strm) {
+			spin_unlock(&zram->strm_lock);
+			wait_event(zram->strm_wait,
+				   !list_empty(&zram->idle_strm));
+			continue;
+		}
+
+		zram->avail_strm++;
+		spin_unlock(&zram->strm_lock);
+
+		strm = zram_strm_alloc(GFP_NOIO);
+		if (strm)
+			return strm;
+
+		spin_lock(&zram->strm_lock);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+static void zram_strm_put(struct zram *zram, struct zram_strm *strm)
+{
+	spin_lock(&zram->strm_lock);
+	if (zram->avail_strm > zram->max_strm) {
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_strm_free(strm);
+		return;
+	}
+
+	list_add(&strm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+	wake_up(&zram->strm_wait);
+}
+
+void zram_set_max_streams(struct zram *zram, int max_strm)
+{
+	struct zram_strm *strm;
+
+	spin_lock(&zram->strm_lock);
+	zram->max_strm = max_strm;
+	/* busy streams in excess are freed by zram_strm_put() */
+	while (zram->avail_strm > max_strm &&
+	       !list_empty(&zram->idle_strm)) {
+		strm = list_first_entry(&zram->idle_strm,
+					struct zram_strm, list);
+		list_del(&strm->list);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_strm_free(strm);
+		spin_lock(&zram->strm_lock);
+	}
+	spin_unlock(&zram->strm_lock);
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,48 +225,41 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/*
+ * Free the object stored for @index, if any.  Called with tb_lock held
+ * for writing.
+ */
 static void zram_free_page(struct zram *zram, size_t index)
 {
-	u32 clen;
-	void *obj;
+	unsigned long handle = zram->table[index].handle;
+	size_t clen = zram->table[index].size;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
-
-	if (unlikely(!page)) {
+	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
 		 */
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
 			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
+			atomic_dec(&zram->stats.pages_zero);
 		}
 		return;
 	}
 
+	zs_free(zram->mem_pool, handle);
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
-	}
-
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+		atomic_dec(&zram->stats.pages_expand);
+	} else if (clen <= PAGE_SIZE / 2)
+		atomic_dec(&zram->stats.good_compress);
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
-
-out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
-	zram_stat_dec(&zram->stats.pages_stored);
+	atomic_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
 static void handle_zero_page(struct bio_vec *bvec)
@@ -189,60 +274,76 @@ static void handle_zero_page(struct bio_vec *bvec)
 	flush_dcache_page(page);
 }
 
-static void handle_uncompressed_page(struct zram *zram, struct bio_vec *bvec,
-				     u32 index, int offset)
+static inline int is_partial_io(struct bio_vec *bvec)
 {
-	struct page *page = bvec->bv_page;
-	unsigned char *user_mem, *cmem;
+	return bvec->bv_len != PAGE_SIZE;
+}
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1);
+/*
+ * Decompress the page stored for @index into @mem.  Called with tb_lock
+ * held for reading.
+ */
+static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
+{
+	int ret = LZO_E_OK;
+	size_t clen = PAGE_SIZE;
+	unsigned char *cmem;
+	unsigned long handle = zram->table[index].handle;
 
-	memcpy(user_mem + bvec->bv_offset, cmem + offset, bvec->bv_len);
-	kunmap_atomic(cmem, KM_USER1);
-	kunmap_atomic(user_mem, KM_USER0);
+	if (zram_test_flag(zram, index, ZRAM_ZERO) || !handle) {
+		memset(mem, 0, PAGE_SIZE);
+		return 0;
+	}
 
-	flush_dcache_page(page);
-}
+	cmem = zs_map_object(zram->mem_pool, handle);
 
-static inline int is_partial_io(struct bio_vec *bvec)
-{
-	return bvec->bv_len != PAGE_SIZE;
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		memcpy(mem, cmem, PAGE_SIZE);
+	else
+		ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
+					    mem, &clen);
+	zs_unmap_object(zram->mem_pool, handle);
+
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret != LZO_E_OK)) {
+		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
+
+	return 0;
 }
 
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
-	size_t clen;
 	struct page *page;
-	struct zobj_header *zheader;
-	unsigned char *user_mem, *cmem, *uncmem = NULL;
+	unsigned char *user_mem, *uncmem = NULL;
 
 	page = bvec->bv_page;
 
+	read_lock(&zram->tb_lock);
 	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+		read_unlock(&zram->tb_lock);
 		handle_zero_page(bvec);
 		return 0;
 	}
 
 	/* Requested page is not present in compressed area */
-	if (unlikely(!zram->table[index].page)) {
+	if (unlikely(!zram->table[index].handle)) {
+		read_unlock(&zram->tb_lock);
 		pr_debug("Read before write: sector=%lu, size=%u",
 			 (ulong)(bio->bi_sector), bio->bi_size);
 		handle_zero_page(bvec);
 		return 0;
 	}
-
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		handle_uncompressed_page(zram, bvec, index, offset);
-		return 0;
-	}
+	read_unlock(&zram->tb_lock);
 
 	if (is_partial_io(bvec)) {
 		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 		if (!uncmem) {
 			pr_info("Error allocating temp memory!\n");
 			return -ENOMEM;
@@ -252,14 +353,10 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	user_mem = kmap_atomic(page, KM_USER0);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
-	clen = PAGE_SIZE;
-
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-		zram->table[index].offset;
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    xv_get_object_size(cmem) - sizeof(*zheader),
-				    uncmem, &clen);
+	read_lock(&zram->tb_lock);
+	ret = zram_decompress_page(zram, uncmem, index);
+	read_unlock(&zram->tb_lock);
 
 	if (is_partial_io(bvec)) {
 		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
@@ -267,98 +364,55 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		kfree(uncmem);
 	}
 
-	kunmap_atomic(cmem, KM_USER1);
 	kunmap_atomic(user_mem, KM_USER0);
 
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
+	if (unlikely(ret))
 		return ret;
-	}
 
 	flush_dcache_page(page);
 
 	return 0;
 }
 
-static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
-{
-	int ret;
-	size_t clen = PAGE_SIZE;
-	struct zobj_header *zheader;
-	unsigned char *cmem;
-
-	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
-	    !zram->table[index].page) {
-		memset(mem, 0, PAGE_SIZE);
-		return 0;
-	}
-
-	cmem = kmap_atomic(zram->table[index].page, KM_USER0) +
-		zram->table[index].offset;
-
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		memcpy(mem, cmem, PAGE_SIZE);
-		kunmap_atomic(cmem, KM_USER0);
-		return 0;
-	}
-
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    xv_get_object_size(cmem) - sizeof(*zheader),
-				    mem, &clen);
-	kunmap_atomic(cmem, KM_USER0);
-
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
-		return ret;
-	}
-
-	return 0;
-}
-
-static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
-			   int offset)
+/*
+ * Compression happens outside of tb_lock, using a stream from the pool,
+ * so that writers on different CPUs proceed in parallel.  Only installing
+ * the new object in the table (and freeing the old one) takes tb_lock.
+ * Called with the index's write_lock held.
+ */
+static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
+			     u32 index, int offset)
 {
 	int ret;
-	u32 store_offset;
 	size_t clen;
-	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	unsigned long handle;
+	struct page *page;
+	struct zram_strm *strm;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
 		 * This is a partial IO. We need to read the full page
 		 * before to write the changes.
 		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 		if (!uncmem) {
 			pr_info("Error allocating temp memory!\n");
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_read_before_write(zram, uncmem, index);
+		read_lock(&zram->tb_lock);
+		ret = zram_decompress_page(zram, uncmem, index);
+		read_unlock(&zram->tb_lock);
 		if (ret) {
 			kfree(uncmem);
 			goto out;
 		}
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].page ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
-
+	strm = zram_strm_get(zram);
 	user_mem = kmap_atomic(page, KM_USER0);
 
 	if (is_partial_io(bvec))
@@ -371,22 +425,29 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		kunmap_atomic(user_mem, KM_USER0);
 		if (is_partial_io(bvec))
 			kfree(uncmem);
-		zram_stat_inc(&zram->stats.pages_zero);
+		zram_strm_put(zram, strm);
+
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
 		zram_set_flag(zram, index, ZRAM_ZERO);
+		write_unlock(&zram->tb_lock);
+		atomic_inc(&zram->stats.pages_zero);
 		ret = 0;
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, strm->buffer, &clen,
+			       strm->workmem);
 
 	kunmap_atomic(user_mem, KM_USER0);
-	if (is_partial_io(bvec))
-			kfree(uncmem);
 
 	if (unlikely(ret != LZO_E_OK)) {
 		pr_err("Compression failed! err=%d\n", ret);
-		goto out;
+		goto out_put;
 	}
 
 	/*
@@ -394,86 +455,85 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	 * since we do not want to return too many disk write
 	 * errors which has side effect of hanging the system.
 	 */
-	if (unlikely(clen > max_zpage_size)) {
+	if (unlikely(clen > max_zpage_size))
 		clen = PAGE_SIZE;
-		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-		if (unlikely(!page_store)) {
-			pr_info("Error allocating memory for "
-				"incompressible page: %u\n", index);
-			ret = -ENOMEM;
-			goto out;
-		}
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
-		zram->table[index].page = page_store;
-		src = kmap_atomic(page, KM_USER0);
-		goto memstore;
-	}
-
-	if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-		      &zram->table[index].page, &store_offset,
-		      GFP_NOIO | __GFP_HIGHMEM)) {
+	handle = zs_malloc(zram->mem_pool, clen);
+	if (!handle) {
 		pr_info("Error allocating memory for compressed "
 			"page: %u, size=%zu\n", index, clen);
 		ret = -ENOMEM;
-		goto out;
+		goto out_put;
 	}
 
-memstore:
-	zram->table[index].offset = store_offset;
-
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-		zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, handle);
+	if (clen == PAGE_SIZE) {
+		src = is_partial_io(bvec) ? uncmem : kmap_atomic(page, KM_USER0);
+		memcpy(cmem, src, PAGE_SIZE);
+		if (!is_partial_io(bvec))
+			kunmap_atomic(src, KM_USER0);
+	} else
+		memcpy(cmem, strm->buffer, clen);
+	zs_unmap_object(zram->mem_pool, handle);
 
-#if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
-		cmem += sizeof(*zheader);
-	}
-#endif
-
-	memcpy(cmem, src, clen);
+	zram_strm_put(zram, strm);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
 
-	kunmap_atomic(cmem, KM_USER1);
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-		kunmap_atomic(src, KM_USER0);
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	write_lock(&zram->tb_lock);
+	zram_free_page(zram, index);
+	zram->table[index].handle = handle;
+	zram->table[index].size = clen;
+	if (clen == PAGE_SIZE)
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+	write_unlock(&zram->tb_lock);
 
 	/* Update stats */
 	zram_stat64_add(zram, &zram->stats.compr_size, clen);
-	zram_stat_inc(&zram->stats.pages_stored);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_inc(&zram->stats.good_compress);
+	atomic_inc(&zram->stats.pages_stored);
+	if (clen == PAGE_SIZE)
+		atomic_inc(&zram->stats.pages_expand);
+	else if (clen <= PAGE_SIZE / 2)
+		atomic_inc(&zram->stats.good_compress);
 
 	return 0;
 
+out_put:
+	zram_strm_put(zram, strm);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
 out:
 	if (ret)
 		zram_stat64_inc(zram, &zram->stats.failed_writes);
 	return ret;
 }
 
-static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
-			int offset, struct bio *bio, int rw)
+static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
+			   int offset)
 {
+	struct mutex *lock = &zram->write_lock[index & (ZRAM_WRITE_LOCKS - 1)];
 	int ret;
 
-	if (rw == READ) {
-		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
-	}
+	mutex_lock(lock);
+	ret = __zram_bvec_write(zram, bvec, index, offset);
+	mutex_unlock(lock);
 
 	return ret;
 }
 
+static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
+			int offset, struct bio *bio, int rw)
+{
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset, bio);
+
+	return zram_bvec_write(zram, bvec, index, offset);
+}
+
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 {
 	if (*offset + bvec->bv_len >= PAGE_SIZE)
@@ -579,38 +639,33 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
+	struct zram_strm *strm, *tmp;
 
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free the compression streams, all of them are idle by now */
+	list_for_each_entry_safe(strm, tmp, &zram->idle_strm, list) {
+		list_del(&strm->list);
+		zram_strm_free(strm);
+	}
+	zram->avail_strm = 0;
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		unsigned long handle = zram->table[index].handle;
 
-		if (!page)
+		if (!handle)
 			continue;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		zs_free(zram->mem_pool, handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -624,6 +679,7 @@ int zram_init_device(struct zram *zram)
 {
 	int ret;
 	size_t num_pages;
+	struct zram_strm *strm;
 
 	mutex_lock(&zram->init_lock);
 
@@ -634,19 +690,15 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	/* zram_strm_get() relies on at least one stream existing */
+	strm = zram_strm_alloc(GFP_KERNEL);
+	if (!strm) {
+		pr_err("Error allocating compression stream!\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
+	list_add(&strm->list, &zram->idle_strm);
+	zram->avail_strm = 1;
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vzalloc(num_pages * sizeof(*zram->table));
@@ -663,7 +715,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -689,7 +741,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -700,12 +754,19 @@ static const struct block_device_operations zram_devops = {
 
 static int create_device(struct zram *zram, int device_id)
 {
-	int ret = 0;
+	int ret = 0, i;
 
-	init_rwsem(&zram->lock);
+	rwlock_init(&zram->tb_lock);
+	for (i = 0; i < ZRAM_WRITE_LOCKS; i++)
+		mutex_init(&zram->write_lock[i]);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
 
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->max_strm = num_online_cpus();
+
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
 		pr_err("Error allocating disk queue for device %d\n",
@@ -17,8 +17,9 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
 
-#include "xvmalloc.h"
+#include "../zsmalloc/zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +27,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -50,9 +39,8 @@ static const unsigned default_disksize_perc_ram = 25;
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ * NOTE: max_zpage_size must be less than or equal to ZS_MAX_ALLOC_SIZE,
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -66,6 +54,9 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
+/* Number of locks serializing writes to the same index, a power of 2 */
+#define ZRAM_WRITE_LOCKS	64
+
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
 	/* Page is stored uncompressed */
@@ -81,8 +72,8 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	unsigned long handle;	/* zsmalloc object */
+	u16 size;	/* compressed size (PAGE_SIZE if uncompressed) */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -95,20 +86,40 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+};
+
+/* Compression workspace, see zram_strm_get() */
+struct zram_strm {
+	void *workmem;		/* LZO1X_MEM_COMPRESS bytes */
+	void *buffer;		/* compressed output, 2 pages */
+	struct list_head list;
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	rwlock_t tb_lock;	/* protect table entries */
+	/*
+	 * Serialize writers of the same index, hashed by index, so that a
+	 * partial write's read-modify-write is not lost to a concurrent one.
+	 */
+	struct mutex write_lock[ZRAM_WRITE_LOCKS];
+
+	/*
+	 * Pool of compression streams: up to max_strm writers can compress
+	 * concurrently, further ones wait for a stream to become idle.
+	 */
+	spinlock_t strm_lock;
+	struct list_head idle_strm;
+	int avail_strm;		/* streams allocated */
+	int max_strm;
+	wait_queue_head_t strm_wait;
+
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -131,5 +142,6 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern void zram_set_max_streams(struct zram *zram, int max_strm);
 
 #endif
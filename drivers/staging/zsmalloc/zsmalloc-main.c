@@ -0,0 +1,518 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released under the terms of GNU General Public License
+ * Version 2.0
+ */
+
+/*
+ * zsmalloc stores objects of up to PAGE_SIZE bytes in size classes
+ * ZS_SIZE_CLASS_DELTA bytes apart.  Each class allocates "zspages" of
+ * 1..ZS_MAX_PAGES_PER_ZSPAGE 0-order pages, the count chosen to waste as
+ * little as possible of the zspage for that class size, and objects are
+ * packed back to back across the pages of a zspage, so an object may
+ * straddle two pages.  As the pages need not be contiguous (and may be
+ * highmem), objects are referred to by an opaque handle and must be
+ * mapped with zs_map_object() before use.  Objects within a single page
+ * are mapped directly; straddling ones are copied through a per-cpu
+ * buffer and written back on zs_unmap_object().
+ *
+ * Allocation prefers the fullest zspages of a class, and a zspage whose
+ * last object is freed is given back to the system immediately.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <asm/page.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+/*
+ * Per-cpu mapping state: straddling objects are copied through ->buf,
+ * objects within a page are kmapped at ->vaddr.
+ */
+struct mapping_area {
+	char *buf;
+	char *vaddr;
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * We have to decide on how many pages to link together
+ * to form a zspage for each size class. This is important
+ * to reduce wastage due to unusable space left at end of
+ * each zspage which is given as:
+ *	wastage = Zp - Zp % size_class
+ * where Zp = zspage size = k * PAGE_SIZE where k = 1, 2, ...
+ *
+ * For example, for size class of 3/8 * PAGE_SIZE, we should
+ * link together 3 PAGE_SIZE sized pages to form a zspage
+ * since then we can perfectly fit in 8 such objects.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	/* zspage order which gives maximum used size per KB */
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct zspage *zspage)
+{
+	int inuse, max_objects;
+
+	inuse = zspage->inuse;
+	max_objects = zspage->class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	else if (inuse == max_objects)
+		return ZS_FULL;
+	else if (inuse <= max_objects / fullness_threshold_frac)
+		return ZS_ALMOST_EMPTY;
+	else
+		return ZS_ALMOST_FULL;
+}
+
+/*
+ * Move @zspage to the fullness list matching its current number of
+ * objects in use.  Called with class->lock held.
+ */
+static void fix_fullness_group(struct zspage *zspage)
+{
+	struct size_class *class = zspage->class;
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(zspage);
+	if (newfg == zspage->fullness)
+		return;
+
+	if (zspage->fullness < _ZS_NR_FULLNESS_GROUPS)
+		list_del(&zspage->list);
+	if (newfg < _ZS_NR_FULLNESS_GROUPS)
+		list_add(&zspage->list, &class->fullness_list[newfg]);
+	zspage->fullness = newfg;
+}
+
+static unsigned long obj_location_to_handle(struct zspage *zspage,
+				unsigned long obj_idx)
+{
+	return (page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS) |
+		(obj_idx & OBJ_INDEX_MASK);
+}
+
+static struct zspage *obj_handle_to_location(unsigned long handle,
+				unsigned long *obj_idx)
+{
+	struct page *page = pfn_to_page(handle >> OBJ_INDEX_BITS);
+
+	*obj_idx = handle & OBJ_INDEX_MASK;
+	return (struct zspage *)page_private(page);
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < zspage->class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	set_page_private(zspage->pages[0], 0);
+	kfree(zspage);
+}
+
+/*
+ * Allocate a zspage for @class and chain all its objects into the free
+ * list, using the first word of each object as link.
+ */
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	struct zspage *zspage;
+	struct link_free *link;
+	void *vaddr = NULL;
+	int i, cur = -1;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	INIT_LIST_HEAD(&zspage->list);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i]) {
+			while (i--)
+				__free_page(zspage->pages[i]);
+			kfree(zspage);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < class->objs_per_zspage; i++) {
+		unsigned long off = i * class->size;
+
+		if ((off >> PAGE_SHIFT) != cur) {
+			if (vaddr)
+				kunmap_atomic(vaddr, KM_USER1);
+			cur = off >> PAGE_SHIFT;
+			vaddr = kmap_atomic(zspage->pages[cur], KM_USER1);
+		}
+		link = vaddr + (off & ~PAGE_MASK);
+		link->next = i + 1;
+	}
+	kunmap_atomic(vaddr, KM_USER1);
+
+	set_page_private(zspage->pages[0], (unsigned long)zspage);
+	return zspage;
+}
+
+static struct link_free *map_link(struct zspage *zspage, unsigned long obj_idx)
+{
+	unsigned long off = obj_idx * zspage->class->size;
+	void *vaddr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+
+	return vaddr + (off & ~PAGE_MASK);
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @flags: allocation flags used to allocate pool metadata and zspages
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(gfp_t flags)
+{
+	int i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class;
+
+		class = &pool->size_class[i];
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->index = i;
+		spin_lock_init(&class->lock);
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->flags = flags;
+	atomic_long_set(&pool->pages_allocated, 0);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+/**
+ * zs_destroy_pool - Destroys a pool, all objects must have been freed.
+ * @pool: pool to destroy
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (!list_empty(&class->fullness_list[fg]))
+				pr_info("Freeing non-empty class with size "
+					"%db, fullness group %d\n",
+					class->size, fg);
+		}
+	}
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * May sleep if the pool's allocation flags allow it.
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	struct link_free *link;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long obj_idx;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(class, pool->flags);
+		if (unlikely(!zspage))
+			return 0;
+
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+		spin_lock(&class->lock);
+	}
+
+	obj_idx = zspage->free_idx;
+	link = map_link(zspage, obj_idx);
+	zspage->free_idx = link->next;
+	kunmap_atomic(link, KM_USER1);
+
+	zspage->inuse++;
+	fix_fullness_group(zspage);
+	spin_unlock(&class->lock);
+
+	return obj_location_to_handle(zspage, obj_idx);
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+/**
+ * zs_free - Free an object allocated by zs_malloc()
+ * @pool: pool the object belongs to
+ * @handle: handle returned by zs_malloc()
+ */
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct link_free *link;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long obj_idx;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	zspage = obj_handle_to_location(handle, &obj_idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+
+	link = map_link(zspage, obj_idx);
+	link->next = zspage->free_idx;
+	kunmap_atomic(link, KM_USER1);
+	zspage->free_idx = obj_idx;
+
+	zspage->inuse--;
+	fix_fullness_group(zspage);
+	fullness = zspage->fullness;
+	spin_unlock(&class->lock);
+
+	/* nobody can find an empty zspage any more */
+	if (fullness == ZS_EMPTY) {
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		free_zspage(zspage);
+	}
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped using
+ * this function.  When done with the object, it must be unmapped using
+ * zs_unmap_object.  The mapping is atomic (KM_USER1 is used), so the
+ * caller must not sleep while it holds it, and only one object can be
+ * mapped at a time on a CPU.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct mapping_area *area;
+	struct zspage *zspage;
+	unsigned long obj_idx, off;
+	unsigned int size, first;
+	char *vaddr;
+	int idx;
+
+	BUG_ON(!handle);
+
+	zspage = obj_handle_to_location(handle, &obj_idx);
+	size = zspage->class->size;
+	off = obj_idx * size;
+	idx = off >> PAGE_SHIFT;
+	off &= ~PAGE_MASK;
+
+	area = &get_cpu_var(zs_map_area);
+	if (off + size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vaddr = kmap_atomic(zspage->pages[idx], KM_USER1);
+		return area->vaddr + off;
+	}
+
+	/* this object spans two pages */
+	first = PAGE_SIZE - off;
+
+	vaddr = kmap_atomic(zspage->pages[idx], KM_USER1);
+	memcpy(area->buf, vaddr + off, first);
+	kunmap_atomic(vaddr, KM_USER1);
+
+	vaddr = kmap_atomic(zspage->pages[idx + 1], KM_USER1);
+	memcpy(area->buf + first, vaddr, size - first);
+	kunmap_atomic(vaddr, KM_USER1);
+
+	return area->buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+/**
+ * zs_unmap_object - unmap an object mapped by zs_map_object()
+ * @pool: pool from which the object was allocated
+ * @handle: handle of the object
+ */
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct mapping_area *area;
+	struct zspage *zspage;
+	unsigned long obj_idx, off;
+	unsigned int size, first;
+	char *vaddr;
+	int idx;
+
+	BUG_ON(!handle);
+
+	zspage = obj_handle_to_location(handle, &obj_idx);
+	size = zspage->class->size;
+	off = obj_idx * size;
+	idx = off >> PAGE_SHIFT;
+	off &= ~PAGE_MASK;
+
+	area = &__get_cpu_var(zs_map_area);
+	if (off + size <= PAGE_SIZE) {
+		kunmap_atomic(area->vaddr, KM_USER1);
+		goto out;
+	}
+
+	/* write back whatever the user changed */
+	first = PAGE_SIZE - off;
+
+	vaddr = kmap_atomic(zspage->pages[idx], KM_USER1);
+	memcpy(vaddr + off, area->buf, first);
+	kunmap_atomic(vaddr, KM_USER1);
+
+	vaddr = kmap_atomic(zspage->pages[idx + 1], KM_USER1);
+	memcpy(vaddr, area->buf + first, size - first);
+	kunmap_atomic(vaddr, KM_USER1);
+out:
+	put_cpu_var(zs_map_area);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/**
+ * zs_get_total_size_bytes - memory used by the pool
+ * @pool: pool to query
+ *
+ * Returns the number of bytes of zspages currently held by @pool.
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+static void zs_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).buf);
+		per_cpu(zs_map_area, cpu).buf = NULL;
+	}
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		char *buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+
+		if (!buf) {
+			zs_exit();
+			return -ENOMEM;
+		}
+		per_cpu(zs_map_area, cpu).buf = buf;
+	}
+
+	return 0;
+}
+
+static void __exit zs_module_exit(void)
+{
+	zs_exit();
+}
+
+module_init(zs_init);
+module_exit(zs_module_exit);
+
+MODULE_LICENSE("GPL");
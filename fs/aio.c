@@ -25,6 +25,7 @@
 #include <linux/file.h>
 #include <linux/mm.h>
 #include <linux/mman.h>
+#include <linux/pagemap.h>
 #include <linux/mmu_context.h>
 #include <linux/slab.h>
 #include <linux/timer.h>
@@ -56,6 +57,18 @@ static struct kmem_cache	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
 
+/*
+ * Per-mm table of the contexts set up with io_setup().  A context's slot
+ * is stored in the id field of its ring, which lives at the context id
+ * userspace passes in, so lookup_ioctx() finds it without walking a list.
+ * Readers use RCU, updates are done under mm->ioctx_lock.
+ */
+struct kioctx_table {
+	struct rcu_head		rcu;
+	unsigned		nr;
+	struct kioctx		*table[];
+};
+
 /* Used for rare fput completion. */
 static void aio_fput_routine(struct work_struct *);
 static DECLARE_WORK(fput_work, aio_fput_routine);
@@ -162,7 +175,6 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
 	ring->nr = nr_events;	/* user copy */
-	ring->id = ctx->user_id;
 	ring->head = ring->tail = 0;
 	ring->magic = AIO_RING_MAGIC;
 	ring->compat_features = AIO_RING_COMPAT_FEATURES;
@@ -190,6 +202,9 @@ static int aio_setup_ring(struct kioctx *ctx)
 	__event;							\
 })
 
+/* number of events io_getevents() pulls off the ring at a time */
+#define AIO_EVENTS_BATCH	8
+
 #define put_aio_ring_event(event, km) do {	\
 	struct io_event *__event = (event);	\
 	(void)__event;				\
@@ -246,6 +261,75 @@ static inline void put_ioctx(struct kioctx *kioctx)
 		__put_ioctx(kioctx);
 }
 
+/* ioctx_add_table
+ *	Installs ctx in the first free slot of mm->ioctx_table, growing the
+ *	table if it is full, and records the slot in the ring header.
+ */
+static int ioctx_add_table(struct kioctx *ctx, struct mm_struct *mm)
+{
+	struct kioctx_table *table, *old;
+	struct aio_ring *ring;
+	unsigned i, new_nr;
+
+	spin_lock(&mm->ioctx_lock);
+	table = rcu_dereference_protected(mm->ioctx_table,
+					  lockdep_is_held(&mm->ioctx_lock));
+
+	while (1) {
+		if (table)
+			for (i = 0; i < table->nr; i++)
+				if (!table->table[i]) {
+					ctx->id = i;
+					rcu_assign_pointer(table->table[i], ctx);
+					spin_unlock(&mm->ioctx_lock);
+
+					ring = kmap_atomic(ctx->ring_info.ring_pages[0],
+							   KM_USER0);
+					ring->id = ctx->id;
+					kunmap_atomic(ring, KM_USER0);
+					return 0;
+				}
+
+		new_nr = (table ? table->nr : 1) * 4;
+		spin_unlock(&mm->ioctx_lock);
+
+		table = kzalloc(sizeof(*table) + sizeof(struct kioctx *) *
+				new_nr, GFP_KERNEL);
+		if (!table)
+			return -ENOMEM;
+
+		table->nr = new_nr;
+
+		spin_lock(&mm->ioctx_lock);
+		old = rcu_dereference_protected(mm->ioctx_table,
+					lockdep_is_held(&mm->ioctx_lock));
+
+		if (!old) {
+			rcu_assign_pointer(mm->ioctx_table, table);
+		} else if (table->nr > old->nr) {
+			memcpy(table->table, old->table,
+			       old->nr * sizeof(struct kioctx *));
+
+			rcu_assign_pointer(mm->ioctx_table, table);
+			kfree_rcu(old, rcu);
+		} else {
+			/* somebody grew it while we were allocating */
+			kfree(table);
+			table = old;
+		}
+	}
+}
+
+/* ioctx_del_table
+ *	Clears ctx's slot in mm->ioctx_table.  Called with mm->ioctx_lock
+ *	held, or once nobody can look contexts up anymore.
+ */
+static void ioctx_del_table(struct kioctx *ctx, struct kioctx_table *table)
+{
+	WARN_ON(ctx != table->table[ctx->id]);
+	rcu_assign_pointer(table->table[ctx->id], NULL);
+}
+
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
@@ -275,8 +359,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 	atomic_set(&ctx->users, 1);
 	spin_lock_init(&ctx->ctx_lock);
-	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	init_llist_head(&ctx->complete_list);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
@@ -306,10 +390,9 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	if (ctx->max_reqs == 0)
 		goto out_cleanup;
 
-	/* now link into global list. */
-	spin_lock(&mm->ioctx_lock);
-	hlist_add_head_rcu(&ctx->list, &mm->ioctx_list);
-	spin_unlock(&mm->ioctx_lock);
+	/* now make it visible to lookup_ioctx() */
+	if (ioctx_add_table(ctx, mm))
+		goto out_cleanup_nomem;
 
 	dprintk("aio: allocated ioctx %p[%ld]: mm=%p mask=0x%x\n",
 		ctx, ctx->user_id, current->mm, ctx->ring_info.nr);
@@ -319,6 +402,10 @@ out_cleanup:
 	__put_ioctx(ctx);
 	return ERR_PTR(-EAGAIN);
 
+out_cleanup_nomem:
+	__put_ioctx(ctx);
+	return ERR_PTR(-ENOMEM);
+
 out_freectx:
 	mmdrop(mm);
 	kmem_cache_free(kioctx_cachep, ctx);
@@ -404,11 +491,18 @@ EXPORT_SYMBOL(wait_on_sync_kiocb);
  */
 void exit_aio(struct mm_struct *mm)
 {
+	struct kioctx_table *table = rcu_dereference_raw(mm->ioctx_table);
 	struct kioctx *ctx;
+	unsigned i;
 
-	while (!hlist_empty(&mm->ioctx_list)) {
-		ctx = hlist_entry(mm->ioctx_list.first, struct kioctx, list);
-		hlist_del_rcu(&ctx->list);
+	if (!table)
+		return;
+
+	for (i = 0; i < table->nr; i++) {
+		ctx = table->table[i];
+		if (!ctx)
+			continue;
+		ioctx_del_table(ctx, table);
 
 		aio_cancel_all(ctx);
 
@@ -425,6 +519,32 @@ void exit_aio(struct mm_struct *mm)
 				ctx->reqs_active);
 		put_ioctx(ctx);
 	}
+
+	RCU_INIT_POINTER(mm->ioctx_table, NULL);
+	kfree(table);
+}
+
+/*
+ * aio_wake_function:
+ *	wait queue function of kiocb->ki_wait, which lock_page_async()
+ *	queues on a locked page instead of sleeping.  Kicks the iocb for
+ *	another retry once the page has been unlocked.
+ */
+static int aio_wake_function(wait_queue_t *wait, unsigned mode,
+			     int sync, void *arg)
+{
+	struct wait_bit_queue *wait_bit
+		= container_of(wait, struct wait_bit_queue, wait);
+	struct wait_bit_key *key = arg;
+
+	if (wait_bit->key.flags != key->flags ||
+	    wait_bit->key.bit_nr != key->bit_nr ||
+	    test_bit(key->bit_nr, key->flags))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(container_of(wait_bit, struct kiocb, ki_wait));
+	return 1;
 }
 
 /* aio_get_req
@@ -458,6 +578,9 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
+	req->ki_wait.key.flags = NULL;
 
 	/* Check if the completion queue has enough free space to
 	 * accept an event from this io.
@@ -591,25 +714,35 @@ EXPORT_SYMBOL(aio_put_req);
 
 static struct kioctx *lookup_ioctx(unsigned long ctx_id)
 {
+	struct aio_ring __user *ring = (void __user *)ctx_id;
 	struct mm_struct *mm = current->mm;
 	struct kioctx *ctx, *ret = NULL;
-	struct hlist_node *n;
+	struct kioctx_table *table;
+	unsigned id;
+
+	/*
+	 * The slot index comes from user memory, so it is only a hint:
+	 * the context found there must still match ctx_id.
+	 */
+	if (get_user(id, &ring->id))
+		return NULL;
 
 	rcu_read_lock();
+	table = rcu_dereference(mm->ioctx_table);
 
-	hlist_for_each_entry_rcu(ctx, n, &mm->ioctx_list, list) {
-		/*
-		 * RCU protects us against accessing freed memory but
-		 * we have to be careful not to get a reference when the
-		 * reference count already dropped to 0 (ctx->dead test
-		 * is unreliable because of races).
-		 */
-		if (ctx->user_id == ctx_id && !ctx->dead && try_get_ioctx(ctx)){
-			ret = ctx;
-			break;
-		}
-	}
+	if (!table || id >= table->nr)
+		goto out;
 
+	ctx = rcu_dereference(table->table[id]);
+	/*
+	 * RCU protects us against accessing freed memory but
+	 * we have to be careful not to get a reference when the
+	 * reference count already dropped to 0 (ctx->dead test
+	 * is unreliable because of races).
+	 */
+	if (ctx && ctx->user_id == ctx_id && !ctx->dead && try_get_ioctx(ctx))
+		ret = ctx;
+out:
 	rcu_read_unlock();
 	return ret;
 }
@@ -703,6 +836,7 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 	/* Quit retrying if the i/o has been cancelled */
 	if (kiocbIsCancelled(iocb)) {
 		ret = -EINTR;
+		cancel_page_wait_async(&iocb->ki_wait);
 		aio_complete(iocb, ret, 0);
 		/* must not access the iocb after this */
 		goto out;
@@ -889,96 +1023,93 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
-/* aio_complete
- *	Called when the io request on the given iocb is complete.
- *	Returns true if this is the last user of the request.  The 
- *	only other user of the request can be the cancellation code.
+/* aio_complete_flush
+ *	Moves the kiocbs queued on ctx->complete_list into the event ring.
+ *	The whole batch is written under a single ctx_lock section, the
+ *	ring tail is published once and waiters are woken once.  Returns
+ *	true if @own was the last user of its request.
  */
-int aio_complete(struct kiocb *iocb, long res, long res2)
+static int aio_complete_flush(struct kioctx *ctx, struct kiocb *own)
 {
-	struct kioctx	*ctx = iocb->ki_ctx;
-	struct aio_ring_info	*info;
+	struct aio_ring_info	*info = &ctx->ring_info;
+	struct llist_node	*node, *next, *batch = NULL;
 	struct aio_ring	*ring;
 	struct io_event	*event;
+	struct kiocb	*iocb;
 	unsigned long	flags;
 	unsigned long	tail;
-	int		ret;
+	int		ret = 0;
 
-	/*
-	 * Special case handling for sync iocbs:
-	 *  - events go directly into the iocb for fast handling
-	 *  - the sync task with the iocb in its stack holds the single iocb
-	 *    ref, no other paths have a way to get another ref
-	 *  - the sync task helpfully left a reference to itself in the iocb
-	 */
-	if (is_sync_kiocb(iocb)) {
-		BUG_ON(iocb->ki_users != 1);
-		iocb->ki_user_data = res;
-		iocb->ki_users = 0;
-		wake_up_process(iocb->ki_obj.tsk);
-		return 1;
-	}
-
-	info = &ctx->ring_info;
-
-	/* add a completion event to the ring buffer.
-	 * must be done holding ctx->ctx_lock to prevent
-	 * other code from messing with the tail
-	 * pointer since we might be called from irq
-	 * context.
-	 */
 	spin_lock_irqsave(&ctx->ctx_lock, flags);
 
-	if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
-		list_del_init(&iocb->ki_run_list);
+	/* llist_del_all() hands them back newest first, restore the order */
+	node = llist_del_all(&ctx->complete_list);
+	while (node) {
+		next = node->next;
+		node->next = batch;
+		batch = node;
+		node = next;
+	}
 
-	/*
-	 * cancelled requests don't get events, userland was given one
-	 * when the event got cancelled.
-	 */
-	if (kiocbIsCancelled(iocb))
-		goto put_rq;
+	/* add the completion events to the ring buffer */
+	tail = info->tail;
+	for (node = batch; node; node = node->next) {
+		iocb = llist_entry(node, struct kiocb, ki_llist);
 
-	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
+		if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
+			list_del_init(&iocb->ki_run_list);
 
-	tail = info->tail;
-	event = aio_ring_event(info, tail, KM_IRQ0);
-	if (++tail >= info->nr)
-		tail = 0;
+		/*
+		 * cancelled requests don't get events, userland was given one
+		 * when the event got cancelled.
+		 */
+		if (kiocbIsCancelled(iocb))
+			continue;
+
+		event = aio_ring_event(info, tail, KM_IRQ0);
+		if (++tail >= info->nr)
+			tail = 0;
+
+		event->obj = (u64)(unsigned long)iocb->ki_obj.user;
+		event->data = iocb->ki_user_data;
+		event->res = iocb->ki_res;
+		event->res2 = iocb->ki_res2;
+		put_aio_ring_event(event, KM_IRQ0);
+
+		dprintk("aio_complete: %p[%lu]: %p: %p %Lx %lx %lx\n",
+			ctx, tail, iocb, iocb->ki_obj.user, iocb->ki_user_data,
+			iocb->ki_res, iocb->ki_res2);
+	}
 
-	event->obj = (u64)(unsigned long)iocb->ki_obj.user;
-	event->data = iocb->ki_user_data;
-	event->res = res;
-	event->res2 = res2;
+	if (tail != info->tail) {
+		ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
 
-	dprintk("aio_complete: %p[%lu]: %p: %p %Lx %lx %lx\n",
-		ctx, tail, iocb, iocb->ki_obj.user, iocb->ki_user_data,
-		res, res2);
+		smp_wmb();	/* make events visible before updating tail */
 
-	/* after flagging the request as done, we
-	 * must never even look at it again
-	 */
-	smp_wmb();	/* make event visible before updating tail */
+		info->tail = tail;
+		ring->tail = tail;
 
-	info->tail = tail;
-	ring->tail = tail;
+		kunmap_atomic(ring, KM_IRQ1);
 
-	put_aio_ring_event(event, KM_IRQ0);
-	kunmap_atomic(ring, KM_IRQ1);
+		pr_debug("added to ring at [%lu]\n", tail);
+	}
 
-	pr_debug("added to ring %p at [%lu]\n", iocb, tail);
+	for (node = batch; node; node = next) {
+		next = node->next;
+		iocb = llist_entry(node, struct kiocb, ki_llist);
 
-	/*
-	 * Check if the user asked us to deliver the result through an
-	 * eventfd. The eventfd_signal() function is safe to be called
-	 * from IRQ context.
-	 */
-	if (iocb->ki_eventfd != NULL)
-		eventfd_signal(iocb->ki_eventfd, 1);
+		/*
+		 * Check if the user asked us to deliver the result through an
+		 * eventfd. The eventfd_signal() function is safe to be called
+		 * from IRQ context.
+		 */
+		if (iocb->ki_eventfd != NULL && !kiocbIsCancelled(iocb))
+			eventfd_signal(iocb->ki_eventfd, 1);
 
-put_rq:
-	/* everything turned out well, dispose of the aiocb. */
-	ret = __aio_put_req(ctx, iocb);
+		/* everything turned out well, dispose of the aiocb. */
+		if (__aio_put_req(ctx, iocb) && iocb == own)
+			ret = 1;
+	}
 
 	/*
 	 * We have to order our ring_info tail store above and test
@@ -994,46 +1125,88 @@ put_rq:
 	spin_unlock_irqrestore(&ctx->ctx_lock, flags);
 	return ret;
 }
+
+/* aio_complete
+ *	Called when the io request on the given iocb is complete.
+ *	Returns true if this is the last user of the request.  The 
+ *	only other user of the request can be the cancellation code.
+ *	A completion that was batched behind a concurrent one returns
+ *	false, the request is then disposed of by the other caller.
+ */
+int aio_complete(struct kiocb *iocb, long res, long res2)
+{
+	struct kioctx	*ctx = iocb->ki_ctx;
+
+	/*
+	 * Special case handling for sync iocbs:
+	 *  - events go directly into the iocb for fast handling
+	 *  - the sync task with the iocb in its stack holds the single iocb
+	 *    ref, no other paths have a way to get another ref
+	 *  - the sync task helpfully left a reference to itself in the iocb
+	 */
+	if (is_sync_kiocb(iocb)) {
+		BUG_ON(iocb->ki_users != 1);
+		iocb->ki_user_data = res;
+		iocb->ki_users = 0;
+		wake_up_process(iocb->ki_obj.tsk);
+		return 1;
+	}
+
+	iocb->ki_res = res;
+	iocb->ki_res2 = res2;
+
+	/*
+	 * Completions are queued on a lockless list, and whoever finds it
+	 * empty drains it into the ring.  Requests completing on other CPUs
+	 * meanwhile only add themselves to the list and leave, so that a
+	 * burst of completions takes ctx_lock, updates the ring tail and
+	 * wakes up the waiters once instead of once per event.
+	 */
+	if (!llist_add(&iocb->ki_llist, &ctx->complete_list))
+		return 0;
+
+	return aio_complete_flush(ctx, iocb);
+}
 EXPORT_SYMBOL(aio_complete);
 
-/* aio_read_evt
- *	Pull an event off of the ioctx's event ring.  Returns the number of 
- *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+/* aio_read_evts
+ *	Pull up to nr events off of the ioctx's event ring.  Returns the
+ *	number of events fetched.  The head is advanced with cmpxchg(), so
+ *	userspace may reap events straight from the mapped ring while we
+ *	are at it; if it got there first we just read again.
  */
-static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
+static int aio_read_evts(struct kioctx *ioctx, struct io_event *ents, long nr)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
-	int ret = 0;
+	unsigned head, tail, cur;
+	int ret;
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
-	dprintk("in aio_read_evt h%lu t%lu m%lu\n",
+	dprintk("in aio_read_evts h%lu t%lu m%lu\n",
 		 (unsigned long)ring->head, (unsigned long)ring->tail,
 		 (unsigned long)ring->nr);
 
-	if (ring->head == ring->tail)
-		goto out;
+	do {
+		head = ACCESS_ONCE(ring->head);
+		tail = ACCESS_ONCE(ring->tail);
+		smp_rmb(); /* read the tail before the events it covers */
+
+		cur = head % info->nr;
+		for (ret = 0; ret < nr && cur != tail; ret++) {
+			struct io_event *evp = aio_ring_event(info, cur, KM_USER1);
+			ents[ret] = *evp;
+			put_aio_ring_event(evp, KM_USER1);
+			cur = (cur + 1) % info->nr;
+		}
+		if (!ret)
+			break;
 
-	spin_lock(&info->ring_lock);
-
-	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
-		*ent = *evp;
-		head = (head + 1) % info->nr;
-		smp_mb(); /* finish reading the event before updatng the head */
-		ring->head = head;
-		ret = 1;
-		put_aio_ring_event(evp, KM_USER1);
-	}
-	spin_unlock(&info->ring_lock);
+		smp_mb(); /* finish reading the events before updating the head */
+	} while (cmpxchg(&ring->head, head, cur) != head);
 
-out:
 	kunmap_atomic(ring, KM_USER0);
-	dprintk("leaving aio_read_evt: %d  h%lu t%lu\n", ret,
+	dprintk("leaving aio_read_evts: %d  h%lu t%lu\n", ret,
 		 (unsigned long)ring->head, (unsigned long)ring->tail);
 	return ret;
 }
@@ -1084,35 +1257,36 @@ static int read_events(struct kioctx *ctx,
 	DECLARE_WAITQUEUE(wait, tsk);
 	int			ret;
 	int			i = 0;
-	struct io_event		ent;
+	struct io_event		ent[AIO_EVENTS_BATCH];
 	struct aio_timeout	to;
 	int			retry = 0;
 
 	/* needed to zero any padding within an entry (there shouldn't be 
 	 * any, but C is fun!
 	 */
-	memset(&ent, 0, sizeof(ent));
+	memset(ent, 0, sizeof(ent));
 retry:
 	ret = 0;
 	while (likely(i < nr)) {
-		ret = aio_read_evt(ctx, &ent);
+		ret = aio_read_evts(ctx, ent, min_t(long, nr - i,
+						    AIO_EVENTS_BATCH));
 		if (unlikely(ret <= 0))
 			break;
 
-		dprintk("read event: %Lx %Lx %Lx %Lx\n",
-			ent.data, ent.obj, ent.res, ent.res2);
+		dprintk("read %d events: %Lx %Lx %Lx %Lx\n", ret,
+			ent[0].data, ent[0].obj, ent[0].res, ent[0].res2);
 
 		/* Could we split the check in two? */
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
+		if (unlikely(copy_to_user(event, ent, ret * sizeof(*ent)))) {
+			dprintk("aio: lost events due to EFAULT.\n");
+			ret = -EFAULT;
 			break;
 		}
-		ret = 0;
 
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
+		/* Good, events copied to userland, update counts. */
+		event += ret;
+		i += ret;
+		ret = 0;
 	}
 
 	if (min_nr <= i)
@@ -1143,7 +1317,8 @@ retry:
 		add_wait_queue_exclusive(&ctx->wait, &wait);
 		do {
 			set_task_state(tsk, TASK_INTERRUPTIBLE);
-			ret = aio_read_evt(ctx, &ent);
+			ret = aio_read_evts(ctx, ent, min_t(long, nr - i,
+							    AIO_EVENTS_BATCH));
 			if (ret)
 				break;
 			if (min_nr <= i)
@@ -1164,7 +1339,6 @@ retry:
 				ret = -EINTR;
 				break;
 			}
-			/*ret = aio_read_evt(ctx, &ent);*/
 		} while (1) ;
 
 		set_task_state(tsk, TASK_RUNNING);
@@ -1173,15 +1347,15 @@ retry:
 		if (unlikely(ret <= 0))
 			break;
 
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
+		if (unlikely(copy_to_user(event, ent, ret * sizeof(*ent)))) {
+			dprintk("aio: lost events due to EFAULT.\n");
+			ret = -EFAULT;
 			break;
 		}
 
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
+		/* Good, events copied to userland, update counts. */
+		event += ret;
+		i += ret;
 	}
 
 	if (timeout)
@@ -1199,11 +1373,13 @@ static void io_destroy(struct kioctx *ioctx)
 	struct mm_struct *mm = current->mm;
 	int was_dead;
 
-	/* delete the entry from the list is someone else hasn't already */
+	/* delete the entry from the table is someone else hasn't already */
 	spin_lock(&mm->ioctx_lock);
 	was_dead = ioctx->dead;
 	ioctx->dead = 1;
-	hlist_del_rcu(&ioctx->list);
+	if (!was_dead)
+		ioctx_del_table(ioctx, rcu_dereference_protected(mm->ioctx_table,
+					lockdep_is_held(&mm->ioctx_lock)));
 	spin_unlock(&mm->ioctx_lock);
 
 	dprintk("aio_release(%p)\n", ioctx);
@@ -1343,6 +1519,15 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 		 (opcode == IOCB_CMD_PWRITEV ||
 		  (!S_ISFIFO(inode->i_mode) && !S_ISSOCK(inode->i_mode))));
 
+	/*
+	 * Buffered reads don't sleep on pages under I/O: the page cache
+	 * queues ki_wait on the page and returns -EIOCBRETRY, and we are
+	 * kicked for another round when the page is unlocked.  Otherwise
+	 * we are done with this iocb, it must not be kicked any more.
+	 */
+	if (opcode == IOCB_CMD_PREADV && ret != -EIOCBRETRY)
+		cancel_page_wait_async(&iocb->ki_wait);
+
 	/* This means we must have transferred all that we could */
 	/* No need to retry anymore */
 	if ((ret == 0) || (iocb->ki_left == 0))
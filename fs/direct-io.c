@@ -109,6 +109,7 @@ struct dio {
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
 	int is_async;			/* is IO async ? */
+	int kernel_pages;		/* iovecs are lowmem kernel addresses */
 	int io_error;			/* IO error in completion path */
 	ssize_t result;                 /* IO result */
 
@@ -196,11 +197,20 @@ static int dio_refill_pages(struct dio *dio)
 	int nr_pages;
 
 	nr_pages = min(dio->total_pages - dio->curr_page, DIO_PAGES);
-	ret = get_user_pages_fast(
-		dio->curr_user_address,		/* Where from? */
-		nr_pages,			/* How many pages? */
-		dio->rw == READ,		/* Write to memory? */
-		&dio->pages[0]);		/* Put results here */
+	if (dio->kernel_pages) {
+		for (ret = 0; ret < nr_pages; ret++) {
+			struct page *page = virt_to_page(dio->curr_user_address +
+							 ret * PAGE_SIZE);
+
+			page_cache_get(page);
+			dio->pages[ret] = page;
+		}
+	} else
+		ret = get_user_pages_fast(
+			dio->curr_user_address,		/* Where from? */
+			nr_pages,			/* How many pages? */
+			dio->rw == READ,		/* Write to memory? */
+			&dio->pages[0]);		/* Put results here */
 
 	if (ret < 0 && dio->blocks_available && (dio->rw & WRITE)) {
 		struct page *page = ZERO_PAGE(0);
@@ -485,7 +495,9 @@ static int dio_bio_complete(struct dio *dio, struct bio *bio)
 		for (page_no = 0; page_no < bio->bi_vcnt; page_no++) {
 			struct page *page = bvec[page_no].bv_page;
 
-			if (dio->rw == READ && !PageCompound(page))
+			/* a kernel caller's pages are its own business */
+			if (dio->rw == READ && !dio->kernel_pages &&
+			    !PageCompound(page))
 				set_page_dirty_lock(page);
 			page_cache_release(page);
 		}
@@ -1287,6 +1299,7 @@ __blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 	 */
 	dio->is_async = !is_sync_kiocb(iocb) && !((rw & WRITE) &&
 		(end > i_size_read(inode)));
+	dio->kernel_pages = test_bit(KIF_KERNEL_PAGES, &iocb->ki_flags);
 
 	retval = direct_io_worker(rw, iocb, inode, iov, offset,
 				nr_segs, blkbits, get_block, end_io,
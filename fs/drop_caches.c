@@ -17,8 +17,8 @@ static void drop_pagecache_sb(struct super_block *sb, void *unused)
 {
 	struct inode *inode, *toput_inode = NULL;
 
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+	lg_global_lock(inode_sb_list_lglock);
+	do_inode_list_for_each_entry(sb, inode) {
 		spin_lock(&inode->i_lock);
 		if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
 		    (inode->i_mapping->nrpages == 0)) {
@@ -27,13 +27,13 @@ static void drop_pagecache_sb(struct super_block *sb, void *unused)
 		}
 		__iget(inode);
 		spin_unlock(&inode->i_lock);
-		spin_unlock(&inode_sb_list_lock);
+		lg_global_unlock(inode_sb_list_lglock);
 		invalidate_mapping_pages(inode->i_mapping, 0, -1);
 		iput(toput_inode);
 		toput_inode = inode;
-		spin_lock(&inode_sb_list_lock);
-	}
-	spin_unlock(&inode_sb_list_lock);
+		lg_global_lock(inode_sb_list_lglock);
+	} while_inode_list_for_each_entry;
+	lg_global_unlock(inode_sb_list_lglock);
 	iput(toput_inode);
 }
 
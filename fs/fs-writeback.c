@@ -1151,7 +1151,7 @@ static void wait_sb_inodes(struct super_block *sb)
 	 */
 	WARN_ON(!rwsem_is_locked(&sb->s_umount));
 
-	spin_lock(&inode_sb_list_lock);
+	lg_global_lock(inode_sb_list_lglock);
 
 	/*
 	 * Data integrity sync. Must wait for all pages under writeback,
@@ -1160,7 +1160,7 @@ static void wait_sb_inodes(struct super_block *sb)
 	 * In which case, the inode may not be on the dirty list, but
 	 * we still have to wait for that writeout.
 	 */
-	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+	do_inode_list_for_each_entry(sb, inode) {
 		struct address_space *mapping = inode->i_mapping;
 
 		spin_lock(&inode->i_lock);
@@ -1171,14 +1171,14 @@ static void wait_sb_inodes(struct super_block *sb)
 		}
 		__iget(inode);
 		spin_unlock(&inode->i_lock);
-		spin_unlock(&inode_sb_list_lock);
+		lg_global_unlock(inode_sb_list_lglock);
 
 		/*
 		 * We hold a reference to 'inode' so it couldn't have been
 		 * removed from s_inodes list while we dropped the
-		 * inode_sb_list_lock.  We cannot iput the inode now as we can
+		 * inode_sb_list_lglock.  We cannot iput the inode now as we can
 		 * be holding the last reference and we cannot iput it under
-		 * inode_sb_list_lock. So we keep the reference and iput it
+		 * inode_sb_list_lglock. So we keep the reference and iput it
 		 * later.
 		 */
 		iput(old_inode);
@@ -1188,9 +1188,9 @@ static void wait_sb_inodes(struct super_block *sb)
 
 		cond_resched();
 
-		spin_lock(&inode_sb_list_lock);
-	}
-	spin_unlock(&inode_sb_list_lock);
+		lg_global_lock(inode_sb_list_lglock);
+	} while_inode_list_for_each_entry;
+	lg_global_unlock(inode_sb_list_lglock);
 	iput(old_inode);
 }
 
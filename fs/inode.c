@@ -33,38 +33,39 @@
  *
  * inode->i_lock protects:
  *   inode->i_state, inode->i_hash, __iget()
- * inode->i_sb->s_inode_lru_lock protects:
- *   inode->i_sb->s_inode_lru, inode->i_lru
- * inode_sb_list_lock protects:
+ * inode_lru->lock protects:
+ *   inode_lru->list and nr_items of one node, inode->i_lru
+ * inode_sb_list_lglock protects:
  *   sb->s_inodes, inode->i_sb_list
+ *   (locally for the list of one cpu, globally to walk all of them,
+ *   offline cpus included)
  * bdi->wb.list_lock protects:
  *   bdi->wb.b_{dirty,io,more_io}, inode->i_wb_list
- * inode_hash_lock protects:
- *   inode_hashtable, inode->i_hash
+ * inode hash bucket lock (bit 0 of the hlist_bl_head) protects:
+ *   the bucket's chain, inode->i_hash
  *
  * Lock ordering:
  *
- * inode_sb_list_lock
+ * inode_sb_list_lglock
  *   inode->i_lock
- *     inode->i_sb->s_inode_lru_lock
+ *     inode_lru->lock
  *
  * bdi->wb.list_lock
  *   inode->i_lock
  *
- * inode_hash_lock
- *   inode_sb_list_lock
+ * inode hash bucket lock
+ *   inode_sb_list_lglock
  *   inode->i_lock
  *
  * iunique_lock
- *   inode_hash_lock
+ *   inode hash bucket lock
  */
 
 static unsigned int i_hash_mask __read_mostly;
 static unsigned int i_hash_shift __read_mostly;
-static struct hlist_head *inode_hashtable __read_mostly;
-static __cacheline_aligned_in_smp DEFINE_SPINLOCK(inode_hash_lock);
+static struct hlist_bl_head *inode_hashtable __read_mostly;
 
-__cacheline_aligned_in_smp DEFINE_SPINLOCK(inode_sb_list_lock);
+DEFINE_LGLOCK(inode_sb_list_lglock);
 
 /*
  * Empty aops. Can be used for the cases where the user does not
@@ -289,7 +290,7 @@ EXPORT_SYMBOL(address_space_init_once);
 void inode_init_once(struct inode *inode)
 {
 	memset(inode, 0, sizeof(*inode));
-	INIT_HLIST_NODE(&inode->i_hash);
+	INIT_HLIST_BL_NODE(&inode->i_hash);
 	INIT_LIST_HEAD(&inode->i_dentry);
 	INIT_LIST_HEAD(&inode->i_devices);
 	INIT_LIST_HEAD(&inode->i_wb_list);
@@ -326,26 +327,75 @@ void ihold(struct inode *inode)
 }
 EXPORT_SYMBOL(ihold);
 
+/*
+ * The unused inode lru of the node the inode itself was allocated on
+ */
+static inline struct inode_lru *inode_lru(struct inode *inode)
+{
+	return &inode->i_sb->s_inode_lru[page_to_nid(virt_to_page(inode))];
+}
+
 static void inode_lru_list_add(struct inode *inode)
 {
-	spin_lock(&inode->i_sb->s_inode_lru_lock);
+	struct inode_lru *lru = inode_lru(inode);
+
+	spin_lock(&lru->lock);
 	if (list_empty(&inode->i_lru)) {
-		list_add(&inode->i_lru, &inode->i_sb->s_inode_lru);
-		inode->i_sb->s_nr_inodes_unused++;
+		list_add(&inode->i_lru, &lru->list);
+		lru->nr_items++;
 		this_cpu_inc(nr_unused);
 	}
-	spin_unlock(&inode->i_sb->s_inode_lru_lock);
+	spin_unlock(&lru->lock);
 }
 
 static void inode_lru_list_del(struct inode *inode)
 {
-	spin_lock(&inode->i_sb->s_inode_lru_lock);
+	struct inode_lru *lru = inode_lru(inode);
+
+	spin_lock(&lru->lock);
 	if (!list_empty(&inode->i_lru)) {
 		list_del_init(&inode->i_lru);
-		inode->i_sb->s_nr_inodes_unused--;
+		lru->nr_items--;
 		this_cpu_dec(nr_unused);
 	}
-	spin_unlock(&inode->i_sb->s_inode_lru_lock);
+	spin_unlock(&lru->lock);
+}
+
+/**
+ * sb_nr_inodes_unused - number of inodes on the superblock's lru lists
+ * @sb: superblock to count
+ */
+int sb_nr_inodes_unused(struct super_block *sb)
+{
+	int nid, sum = 0;
+
+	for (nid = 0; nid < nr_node_ids; nid++)
+		sum += sb->s_inode_lru[nid].nr_items;
+	return sum;
+}
+
+static inline int inode_list_cpu(struct inode *inode)
+{
+#ifdef CONFIG_SMP
+	return inode->i_sb_list_cpu;
+#else
+	return smp_processor_id();
+#endif
+}
+
+/* helper for inode_sb_list_add to reduce ifdefs */
+static inline void __inode_sb_list_add(struct inode *inode)
+{
+	struct list_head *list;
+#ifdef CONFIG_SMP
+	int cpu;
+	cpu = smp_processor_id();
+	inode->i_sb_list_cpu = cpu;
+	list = per_cpu_ptr(inode->i_sb->s_inodes, cpu);
+#else
+	list = &inode->i_sb->s_inodes;
+#endif
+	list_add(&inode->i_sb_list, list);
 }
 
 /**
@@ -354,21 +404,43 @@ static void inode_lru_list_del(struct inode *inode)
  */
 void inode_sb_list_add(struct inode *inode)
 {
-	spin_lock(&inode_sb_list_lock);
-	list_add(&inode->i_sb_list, &inode->i_sb->s_inodes);
-	spin_unlock(&inode_sb_list_lock);
+	lg_local_lock(inode_sb_list_lglock);
+	__inode_sb_list_add(inode);
+	lg_local_unlock(inode_sb_list_lglock);
 }
 EXPORT_SYMBOL_GPL(inode_sb_list_add);
 
+/*
+ * The cpu whose list the inode is on may be offline by now: its lock is
+ * still valid, and taken by lg_global_lock() walkers like any other.
+ */
 static inline void inode_sb_list_del(struct inode *inode)
 {
 	if (!list_empty(&inode->i_sb_list)) {
-		spin_lock(&inode_sb_list_lock);
+		lg_local_lock_cpu(inode_sb_list_lglock, inode_list_cpu(inode));
 		list_del_init(&inode->i_sb_list);
-		spin_unlock(&inode_sb_list_lock);
+		lg_local_unlock_cpu(inode_sb_list_lglock, inode_list_cpu(inode));
 	}
 }
 
+/**
+ * sb_inode_list_empty - check if a superblock has no inodes left
+ * @sb: superblock to check
+ */
+int sb_inode_list_empty(struct super_block *sb)
+{
+#ifdef CONFIG_SMP
+	int i;
+
+	for_each_possible_cpu(i)
+		if (!list_empty(per_cpu_ptr(sb->s_inodes, i)))
+			return 0;
+	return 1;
+#else
+	return list_empty(&sb->s_inodes);
+#endif
+}
+
 static unsigned long hash(struct super_block *sb, unsigned long hashval)
 {
 	unsigned long tmp;
@@ -379,6 +451,17 @@ static unsigned long hash(struct super_block *sb, unsigned long hashval)
 	return tmp & i_hash_mask;
 }
 
+/*
+ * Add an inode to hash chain @b, with the chain's bucket lock held.
+ * The bucket is remembered for __remove_inode_hash(), which can't
+ * recompute it: inodes may be hashed by something else than i_ino.
+ */
+static void __inode_hash_add(struct inode *inode, struct hlist_bl_head *b)
+{
+	inode->i_hash_bucket = b - inode_hashtable;
+	hlist_bl_add_head(&inode->i_hash, b);
+}
+
 /**
  *	__insert_inode_hash - hash an inode
  *	@inode: unhashed inode
@@ -389,13 +472,13 @@ static unsigned long hash(struct super_block *sb, unsigned long hashval)
  */
 void __insert_inode_hash(struct inode *inode, unsigned long hashval)
 {
-	struct hlist_head *b = inode_hashtable + hash(inode->i_sb, hashval);
+	struct hlist_bl_head *b = inode_hashtable + hash(inode->i_sb, hashval);
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(b);
 	spin_lock(&inode->i_lock);
-	hlist_add_head(&inode->i_hash, b);
+	__inode_hash_add(inode, b);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(b);
 }
 EXPORT_SYMBOL(__insert_inode_hash);
 
@@ -407,11 +490,13 @@ EXPORT_SYMBOL(__insert_inode_hash);
  */
 void __remove_inode_hash(struct inode *inode)
 {
-	spin_lock(&inode_hash_lock);
+	struct hlist_bl_head *b = inode_hashtable + inode->i_hash_bucket;
+
+	hlist_bl_lock(b);
 	spin_lock(&inode->i_lock);
-	hlist_del_init(&inode->i_hash);
+	hlist_bl_del_init(&inode->i_hash);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(b);
 }
 EXPORT_SYMBOL(__remove_inode_hash);
 
@@ -512,11 +597,11 @@ static void dispose_list(struct list_head *head)
  */
 void evict_inodes(struct super_block *sb)
 {
-	struct inode *inode, *next;
+	struct inode *inode;
 	LIST_HEAD(dispose);
 
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry_safe(inode, next, &sb->s_inodes, i_sb_list) {
+	lg_global_lock(inode_sb_list_lglock);
+	do_inode_list_for_each_entry(sb, inode) {
 		if (atomic_read(&inode->i_count))
 			continue;
 
@@ -530,8 +615,8 @@ void evict_inodes(struct super_block *sb)
 		inode_lru_list_del(inode);
 		spin_unlock(&inode->i_lock);
 		list_add(&inode->i_lru, &dispose);
-	}
-	spin_unlock(&inode_sb_list_lock);
+	} while_inode_list_for_each_entry;
+	lg_global_unlock(inode_sb_list_lglock);
 
 	dispose_list(&dispose);
 }
@@ -549,11 +634,11 @@ void evict_inodes(struct super_block *sb)
 int invalidate_inodes(struct super_block *sb, bool kill_dirty)
 {
 	int busy = 0;
-	struct inode *inode, *next;
+	struct inode *inode;
 	LIST_HEAD(dispose);
 
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry_safe(inode, next, &sb->s_inodes, i_sb_list) {
+	lg_global_lock(inode_sb_list_lglock);
+	do_inode_list_for_each_entry(sb, inode) {
 		spin_lock(&inode->i_lock);
 		if (inode->i_state & (I_NEW | I_FREEING | I_WILL_FREE)) {
 			spin_unlock(&inode->i_lock);
@@ -574,8 +659,8 @@ int invalidate_inodes(struct super_block *sb, bool kill_dirty)
 		inode_lru_list_del(inode);
 		spin_unlock(&inode->i_lock);
 		list_add(&inode->i_lru, &dispose);
-	}
-	spin_unlock(&inode_sb_list_lock);
+	} while_inode_list_for_each_entry;
+	lg_global_unlock(inode_sb_list_lglock);
 
 	dispose_list(&dispose);
 
@@ -596,10 +681,9 @@ static int can_unuse(struct inode *inode)
 }
 
 /*
- * Walk the superblock inode LRU for freeable inodes and attempt to free them.
- * This is called from the superblock shrinker function with a number of inodes
- * to trim from the LRU. Inodes to be freed are moved to a temporary list and
- * then are freed outside inode_lock by dispose_list().
+ * Walk one node's inode LRU of a superblock for freeable inodes and attempt
+ * to free them.  Inodes to be freed are moved to @freeable, for the caller
+ * to free outside the lru lock with dispose_list().
  *
  * Any inodes which are pinned purely because of attached pagecache have their
  * pagecache removed.  If the inode has metadata buffers attached to
@@ -613,28 +697,28 @@ static int can_unuse(struct inode *inode)
  * LRU does not have strict ordering. Hence we don't want to reclaim inodes
  * with this flag set because they are the inodes that are out of order.
  */
-void prune_icache_sb(struct super_block *sb, int nr_to_scan)
+static void prune_icache_lru(struct inode_lru *lru, int nr_to_scan,
+			     struct list_head *freeable)
 {
-	LIST_HEAD(freeable);
 	int nr_scanned;
 	unsigned long reap = 0;
 
-	spin_lock(&sb->s_inode_lru_lock);
+	spin_lock(&lru->lock);
 	for (nr_scanned = nr_to_scan; nr_scanned >= 0; nr_scanned--) {
 		struct inode *inode;
 
-		if (list_empty(&sb->s_inode_lru))
+		if (list_empty(&lru->list))
 			break;
 
-		inode = list_entry(sb->s_inode_lru.prev, struct inode, i_lru);
+		inode = list_entry(lru->list.prev, struct inode, i_lru);
 
 		/*
-		 * we are inverting the sb->s_inode_lru_lock/inode->i_lock here,
+		 * we are inverting the lru->lock/inode->i_lock here,
 		 * so use a trylock. If we fail to get the lock, just move the
 		 * inode to the back of the list so we don't spin on it.
 		 */
 		if (!spin_trylock(&inode->i_lock)) {
-			list_move(&inode->i_lru, &sb->s_inode_lru);
+			list_move(&inode->i_lru, &lru->list);
 			continue;
 		}
 
@@ -646,7 +730,7 @@ void prune_icache_sb(struct super_block *sb, int nr_to_scan)
 		    (inode->i_state & ~I_REFERENCED)) {
 			list_del_init(&inode->i_lru);
 			spin_unlock(&inode->i_lock);
-			sb->s_nr_inodes_unused--;
+			lru->nr_items--;
 			this_cpu_dec(nr_unused);
 			continue;
 		}
@@ -654,21 +738,21 @@ void prune_icache_sb(struct super_block *sb, int nr_to_scan)
 		/* recently referenced inodes get one more pass */
 		if (inode->i_state & I_REFERENCED) {
 			inode->i_state &= ~I_REFERENCED;
-			list_move(&inode->i_lru, &sb->s_inode_lru);
+			list_move(&inode->i_lru, &lru->list);
 			spin_unlock(&inode->i_lock);
 			continue;
 		}
 		if (inode_has_buffers(inode) || inode->i_data.nrpages) {
 			__iget(inode);
 			spin_unlock(&inode->i_lock);
-			spin_unlock(&sb->s_inode_lru_lock);
+			spin_unlock(&lru->lock);
 			if (remove_inode_buffers(inode))
 				reap += invalidate_mapping_pages(&inode->i_data,
 								0, -1);
 			iput(inode);
-			spin_lock(&sb->s_inode_lru_lock);
+			spin_lock(&lru->lock);
 
-			if (inode != list_entry(sb->s_inode_lru.next,
+			if (inode != list_entry(lru->list.next,
 						struct inode, i_lru))
 				continue;	/* wrong inode or list_empty */
 			/* avoid lock inversions with trylock */
@@ -683,33 +767,58 @@ void prune_icache_sb(struct super_block *sb, int nr_to_scan)
 		inode->i_state |= I_FREEING;
 		spin_unlock(&inode->i_lock);
 
-		list_move(&inode->i_lru, &freeable);
-		sb->s_nr_inodes_unused--;
+		list_move(&inode->i_lru, freeable);
+		lru->nr_items--;
 		this_cpu_dec(nr_unused);
 	}
 	if (current_is_kswapd())
 		__count_vm_events(KSWAPD_INODESTEAL, reap);
 	else
 		__count_vm_events(PGINODESTEAL, reap);
-	spin_unlock(&sb->s_inode_lru_lock);
+	spin_unlock(&lru->lock);
+}
+
+/*
+ * Walk the superblock inode LRUs for freeable inodes and attempt to free them.
+ * This is called from the superblock shrinker function with a number of inodes
+ * to trim from the LRUs, which is spread over the nodes by how many unused
+ * inodes each of them has. Inodes to be freed are moved to a temporary list
+ * and then are freed outside the lru locks by dispose_list().
+ */
+void prune_icache_sb(struct super_block *sb, int nr_to_scan)
+{
+	LIST_HEAD(freeable);
+	int total = sb_nr_inodes_unused(sb);
+	int nid;
+
+	for (nid = 0; total > 0 && nid < nr_node_ids; nid++) {
+		struct inode_lru *lru = &sb->s_inode_lru[nid];
+		int nr_items = lru->nr_items;
+
+		if (nr_items <= 0)
+			continue;
+		prune_icache_lru(lru, div_u64((u64)nr_to_scan * nr_items +
+					      total - 1, total), &freeable);
+	}
 
 	dispose_list(&freeable);
 }
 
-static void __wait_on_freeing_inode(struct inode *inode);
+static void __wait_on_freeing_inode(struct inode *inode,
+				    struct hlist_bl_head *b);
 /*
- * Called with the inode lock held.
+ * Called with the hash bucket lock of @head held.
  */
 static struct inode *find_inode(struct super_block *sb,
-				struct hlist_head *head,
+				struct hlist_bl_head *head,
 				int (*test)(struct inode *, void *),
 				void *data)
 {
-	struct hlist_node *node;
+	struct hlist_bl_node *node;
 	struct inode *inode = NULL;
 
 repeat:
-	hlist_for_each_entry(inode, node, head, i_hash) {
+	hlist_bl_for_each_entry(inode, node, head, i_hash) {
 		spin_lock(&inode->i_lock);
 		if (inode->i_sb != sb) {
 			spin_unlock(&inode->i_lock);
@@ -720,7 +829,7 @@ repeat:
 			continue;
 		}
 		if (inode->i_state & (I_FREEING|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, head);
 			goto repeat;
 		}
 		__iget(inode);
@@ -735,13 +844,13 @@ repeat:
  * iget_locked for details.
  */
 static struct inode *find_inode_fast(struct super_block *sb,
-				struct hlist_head *head, unsigned long ino)
+				struct hlist_bl_head *head, unsigned long ino)
 {
-	struct hlist_node *node;
+	struct hlist_bl_node *node;
 	struct inode *inode = NULL;
 
 repeat:
-	hlist_for_each_entry(inode, node, head, i_hash) {
+	hlist_bl_for_each_entry(inode, node, head, i_hash) {
 		spin_lock(&inode->i_lock);
 		if (inode->i_ino != ino) {
 			spin_unlock(&inode->i_lock);
@@ -752,7 +861,7 @@ repeat:
 			continue;
 		}
 		if (inode->i_state & (I_FREEING|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, head);
 			goto repeat;
 		}
 		__iget(inode);
@@ -839,8 +948,6 @@ struct inode *new_inode(struct super_block *sb)
 {
 	struct inode *inode;
 
-	spin_lock_prefetch(&inode_sb_list_lock);
-
 	inode = new_inode_pseudo(sb);
 	if (inode)
 		inode_sb_list_add(inode);
@@ -905,19 +1012,19 @@ EXPORT_SYMBOL(unlock_new_inode);
  * hashed, and with the I_NEW flag set. The file system gets to fill it in
  * before unlocking it via unlock_new_inode().
  *
- * Note both @test and @set are called with the inode_hash_lock held, so can't
+ * Note both @test and @set are called with the inode hash bucket lock held, so can't
  * sleep.
  */
 struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *),
 		int (*set)(struct inode *, void *), void *data)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = inode_hashtable + hash(sb, hashval);
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(head);
 	inode = find_inode(sb, head, test, data);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 
 	if (inode) {
 		wait_on_inode(inode);
@@ -928,7 +1035,7 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 	if (inode) {
 		struct inode *old;
 
-		spin_lock(&inode_hash_lock);
+		hlist_bl_lock(head);
 		/* We released the lock, so.. */
 		old = find_inode(sb, head, test, data);
 		if (!old) {
@@ -937,10 +1044,10 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 
 			spin_lock(&inode->i_lock);
 			inode->i_state = I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
 			inode_sb_list_add(inode);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -953,7 +1060,7 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		 * us. Use the old inode instead of the one we just
 		 * allocated.
 		 */
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -961,7 +1068,7 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 	return inode;
 
 set_failed:
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 	destroy_inode(inode);
 	return NULL;
 }
@@ -982,12 +1089,12 @@ EXPORT_SYMBOL(iget5_locked);
  */
 struct inode *iget_locked(struct super_block *sb, unsigned long ino)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *head = inode_hashtable + hash(sb, ino);
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(head);
 	inode = find_inode_fast(sb, head, ino);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 	if (inode) {
 		wait_on_inode(inode);
 		return inode;
@@ -997,17 +1104,17 @@ struct inode *iget_locked(struct super_block *sb, unsigned long ino)
 	if (inode) {
 		struct inode *old;
 
-		spin_lock(&inode_hash_lock);
+		hlist_bl_lock(head);
 		/* We released the lock, so.. */
 		old = find_inode_fast(sb, head, ino);
 		if (!old) {
 			inode->i_ino = ino;
 			spin_lock(&inode->i_lock);
 			inode->i_state = I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
 			inode_sb_list_add(inode);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -1020,7 +1127,7 @@ struct inode *iget_locked(struct super_block *sb, unsigned long ino)
 		 * us. Use the old inode instead of the one we just
 		 * allocated.
 		 */
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -1038,18 +1145,18 @@ EXPORT_SYMBOL(iget_locked);
  */
 static int test_inode_iunique(struct super_block *sb, unsigned long ino)
 {
-	struct hlist_head *b = inode_hashtable + hash(sb, ino);
-	struct hlist_node *node;
+	struct hlist_bl_head *b = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_node *node;
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
-	hlist_for_each_entry(inode, node, b, i_hash) {
+	hlist_bl_lock(b);
+	hlist_bl_for_each_entry(inode, node, b, i_hash) {
 		if (inode->i_ino == ino && inode->i_sb == sb) {
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(b);
 			return 0;
 		}
 	}
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(b);
 
 	return 1;
 }
@@ -1124,17 +1231,17 @@ EXPORT_SYMBOL(igrab);
  * Note: I_NEW is not waited upon so you have to be very careful what you do
  * with the returned inode.  You probably should be using ilookup5() instead.
  *
- * Note2: @test is called with the inode_hash_lock held, so can't sleep.
+ * Note2: @test is called with the inode hash bucket lock held, so can't sleep.
  */
 struct inode *ilookup5_nowait(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = inode_hashtable + hash(sb, hashval);
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(head);
 	inode = find_inode(sb, head, test, data);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 
 	return inode;
 }
@@ -1155,7 +1262,7 @@ EXPORT_SYMBOL(ilookup5_nowait);
  * This is a generalized version of ilookup() for file systems where the
  * inode number is not sufficient for unique identification of an inode.
  *
- * Note: @test is called with the inode_hash_lock held, so can't sleep.
+ * Note: @test is called with the inode hash bucket lock held, so can't sleep.
  */
 struct inode *ilookup5(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -1178,12 +1285,12 @@ EXPORT_SYMBOL(ilookup5);
  */
 struct inode *ilookup(struct super_block *sb, unsigned long ino)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *head = inode_hashtable + hash(sb, ino);
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(head);
 	inode = find_inode_fast(sb, head, ino);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 
 	if (inode)
 		wait_on_inode(inode);
@@ -1195,13 +1302,13 @@ int insert_inode_locked(struct inode *inode)
 {
 	struct super_block *sb = inode->i_sb;
 	ino_t ino = inode->i_ino;
-	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *head = inode_hashtable + hash(sb, ino);
 
 	while (1) {
-		struct hlist_node *node;
+		struct hlist_bl_node *node;
 		struct inode *old = NULL;
-		spin_lock(&inode_hash_lock);
-		hlist_for_each_entry(old, node, head, i_hash) {
+		hlist_bl_lock(head);
+		hlist_bl_for_each_entry(old, node, head, i_hash) {
 			if (old->i_ino != ino)
 				continue;
 			if (old->i_sb != sb)
@@ -1216,14 +1323,14 @@ int insert_inode_locked(struct inode *inode)
 		if (likely(!node)) {
 			spin_lock(&inode->i_lock);
 			inode->i_state |= I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 			return 0;
 		}
 		__iget(old);
 		spin_unlock(&old->i_lock);
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		wait_on_inode(old);
 		if (unlikely(!inode_unhashed(old))) {
 			iput(old);
@@ -1238,14 +1345,14 @@ int insert_inode_locked4(struct inode *inode, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
 {
 	struct super_block *sb = inode->i_sb;
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = inode_hashtable + hash(sb, hashval);
 
 	while (1) {
-		struct hlist_node *node;
+		struct hlist_bl_node *node;
 		struct inode *old = NULL;
 
-		spin_lock(&inode_hash_lock);
-		hlist_for_each_entry(old, node, head, i_hash) {
+		hlist_bl_lock(head);
+		hlist_bl_for_each_entry(old, node, head, i_hash) {
 			if (old->i_sb != sb)
 				continue;
 			if (!test(old, data))
@@ -1260,14 +1367,14 @@ int insert_inode_locked4(struct inode *inode, unsigned long hashval,
 		if (likely(!node)) {
 			spin_lock(&inode->i_lock);
 			inode->i_state |= I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 			return 0;
 		}
 		__iget(old);
 		spin_unlock(&old->i_lock);
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		wait_on_inode(old);
 		if (unlikely(!inode_unhashed(old))) {
 			iput(old);
@@ -1540,17 +1647,18 @@ EXPORT_SYMBOL(inode_wait);
  * wake_up_bit(&inode->i_state, __I_NEW) after removing from the hash list
  * will DTRT.
  */
-static void __wait_on_freeing_inode(struct inode *inode)
+static void __wait_on_freeing_inode(struct inode *inode,
+				    struct hlist_bl_head *b)
 {
 	wait_queue_head_t *wq;
 	DEFINE_WAIT_BIT(wait, &inode->i_state, __I_NEW);
 	wq = bit_waitqueue(&inode->i_state, __I_NEW);
 	prepare_to_wait(wq, &wait.wait, TASK_UNINTERRUPTIBLE);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(b);
 	schedule();
 	finish_wait(wq, &wait.wait);
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(b);
 }
 
 static __initdata unsigned long ihash_entries;
@@ -1578,7 +1686,7 @@ void __init inode_init_early(void)
 
 	inode_hashtable =
 		alloc_large_system_hash("Inode-cache",
-					sizeof(struct hlist_head),
+					sizeof(struct hlist_bl_head),
 					ihash_entries,
 					14,
 					HASH_EARLY,
@@ -1587,13 +1695,15 @@ void __init inode_init_early(void)
 					0);
 
 	for (loop = 0; loop < (1 << i_hash_shift); loop++)
-		INIT_HLIST_HEAD(&inode_hashtable[loop]);
+		INIT_HLIST_BL_HEAD(&inode_hashtable[loop]);
 }
 
 void __init inode_init(void)
 {
 	int loop;
 
+	lg_lock_init(inode_sb_list_lglock);
+
 	/* inode slab cache */
 	inode_cachep = kmem_cache_create("inode_cache",
 					 sizeof(struct inode),
@@ -1608,7 +1718,7 @@ void __init inode_init(void)
 
 	inode_hashtable =
 		alloc_large_system_hash("Inode-cache",
-					sizeof(struct hlist_head),
+					sizeof(struct hlist_bl_head),
 					ihash_entries,
 					14,
 					0,
@@ -1617,7 +1727,7 @@ void __init inode_init(void)
 					0);
 
 	for (loop = 0; loop < (1 << i_hash_shift); loop++)
-		INIT_HLIST_HEAD(&inode_hashtable[loop]);
+		INIT_HLIST_BL_HEAD(&inode_hashtable[loop]);
 }
 
 void init_special_inode(struct inode *inode, umode_t mode, dev_t rdev)
@@ -126,7 +126,44 @@ extern long do_handle_open(int mountdirfd,
 /*
  * inode.c
  */
-extern spinlock_t inode_sb_list_lock;
+DECLARE_LGLOCK(inode_sb_list_lglock);
+
+extern int sb_nr_inodes_unused(struct super_block *);
+extern int sb_inode_list_empty(struct super_block *);
+
+#ifdef CONFIG_SMP
+
+/*
+ * These macros iterate all inodes on all CPUs for a given superblock.
+ * inode_sb_list_lglock must be held globally with lg_global_lock(), which
+ * takes the lock of every possible cpu: an inode stays on the list of the
+ * cpu that added it even after that cpu went offline, so the lists of
+ * offline cpus are walked too, and lg_global_lock_online() won't do.
+ */
+#define do_inode_list_for_each_entry(__sb, __inode)		\
+{								\
+	int i;							\
+	for_each_possible_cpu(i) {				\
+		struct list_head *list;				\
+		list = per_cpu_ptr((__sb)->s_inodes, i);	\
+		list_for_each_entry((__inode), list, i_sb_list)
+
+#define while_inode_list_for_each_entry				\
+	}							\
+}
+
+#else
+
+#define do_inode_list_for_each_entry(__sb, __inode)		\
+{								\
+	struct list_head *list;					\
+	list = &(__sb)->s_inodes;				\
+	list_for_each_entry((__inode), list, i_sb_list)
+
+#define while_inode_list_for_each_entry				\
+}
+
+#endif
 
 /*
  * fs-writeback.c
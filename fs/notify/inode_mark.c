@@ -234,18 +234,15 @@ out:
 	return ret;
 }
 
-/**
- * fsnotify_unmount_inodes - an sb is unmounting.  handle any watched inodes.
- * @list: list of inodes being unmounted (sb->s_inodes)
- *
- * Called during unmount with no locks held, so needs to be safe against
- * concurrent modifiers. We temporarily drop inode_sb_list_lock and CAN block.
+/*
+ * Handle the watched inodes on one of the per-cpu lists of an unmounting
+ * sb.  We temporarily drop inode_sb_list_lglock and CAN block.
  */
-void fsnotify_unmount_inodes(struct list_head *list)
+static void fsnotify_unmount_inode_list(struct list_head *list)
 {
 	struct inode *inode, *next_i, *need_iput = NULL;
 
-	spin_lock(&inode_sb_list_lock);
+	lg_global_lock(inode_sb_list_lglock);
 	list_for_each_entry_safe(inode, next_i, list, i_sb_list) {
 		struct inode *need_iput_tmp;
 
@@ -293,11 +290,11 @@ void fsnotify_unmount_inodes(struct list_head *list)
 		}
 
 		/*
-		 * We can safely drop inode_sb_list_lock here because we hold
+		 * We can safely drop inode_sb_list_lglock here because we hold
 		 * references on both inode and next_i.  Also no new inodes
 		 * will be added since the umount has begun.
 		 */
-		spin_unlock(&inode_sb_list_lock);
+		lg_global_unlock(inode_sb_list_lglock);
 
 		if (need_iput_tmp)
 			iput(need_iput_tmp);
@@ -309,7 +306,26 @@ void fsnotify_unmount_inodes(struct list_head *list)
 
 		iput(inode);
 
-		spin_lock(&inode_sb_list_lock);
+		lg_global_lock(inode_sb_list_lglock);
 	}
-	spin_unlock(&inode_sb_list_lock);
+	lg_global_unlock(inode_sb_list_lglock);
+}
+
+/**
+ * fsnotify_unmount_inodes - an sb is unmounting.  handle any watched inodes.
+ * @sb: superblock being unmounted
+ *
+ * Called during unmount with no locks held, so needs to be safe against
+ * concurrent modifiers.
+ */
+void fsnotify_unmount_inodes(struct super_block *sb)
+{
+#ifdef CONFIG_SMP
+	int i;
+
+	for_each_possible_cpu(i)
+		fsnotify_unmount_inode_list(per_cpu_ptr(sb->s_inodes, i));
+#else
+	fsnotify_unmount_inode_list(&sb->s_inodes);
+#endif
 }
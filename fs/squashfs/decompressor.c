@@ -25,6 +25,9 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
+#include <linux/list.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -83,11 +86,139 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
-void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+/*
+ * Decompressor streams are kept in a per-superblock pool, so that blocks
+ * can be decompressed in parallel by as many readers as there are streams.
+ * The pool starts out with one stream, allocated at mount time, and grows
+ * on demand up to max_streams, which defaults to the number of online CPUs
+ * and can be set with the threads= mount option.  A reader that finds no
+ * idle stream and cannot grow the pool waits for a stream to be returned.
+ */
+struct squashfs_stream {
+	void			*comp_opts;	/* raw compressor options */
+	int			comp_opts_len;
+	struct mutex		mutex;
+	struct list_head	idle;		/* idle decomp_streams */
+	int			nr_streams;	/* allocated or being allocated */
+	int			max_streams;
+	wait_queue_head_t	wait;
+};
+
+struct decomp_stream {
+	void			*stream;
+	struct list_head	list;
+};
+
+static struct decomp_stream *alloc_decomp_stream(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream = msblk->stream;
+	struct decomp_stream *decomp_strm;
+	void *strm;
+
+	decomp_strm = kmalloc(sizeof(*decomp_strm), GFP_KERNEL);
+	if (decomp_strm == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	strm = msblk->decompressor->init(msblk, stream->comp_opts,
+		stream->comp_opts_len);
+	if (IS_ERR(strm)) {
+		kfree(decomp_strm);
+		return strm;
+	}
+
+	decomp_strm->stream = strm;
+	return decomp_strm;
+}
+
+
+static void free_decomp_stream(struct squashfs_sb_info *msblk,
+	struct decomp_stream *decomp_strm)
+{
+	msblk->decompressor->free(decomp_strm->stream);
+	kfree(decomp_strm);
+}
+
+
+static struct decomp_stream *get_decomp_stream(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream = msblk->stream;
+	struct decomp_stream *decomp_strm;
+
+	for (;;) {
+		mutex_lock(&stream->mutex);
+		if (!list_empty(&stream->idle)) {
+			decomp_strm = list_first_entry(&stream->idle,
+				struct decomp_stream, list);
+			list_del(&decomp_strm->list);
+			mutex_unlock(&stream->mutex);
+			return decomp_strm;
+		}
+
+		if (stream->nr_streams < stream->max_streams) {
+			/*
+			 * Reserve the slot and allocate outside the mutex, so
+			 * that other readers can still return their streams.
+			 */
+			stream->nr_streams++;
+			mutex_unlock(&stream->mutex);
+
+			decomp_strm = alloc_decomp_stream(msblk);
+			if (!IS_ERR(decomp_strm))
+				return decomp_strm;
+
+			/*
+			 * Out of memory.  There is always at least the stream
+			 * allocated at mount time, so wait for it instead.
+			 */
+			mutex_lock(&stream->mutex);
+			stream->nr_streams--;
+		}
+		mutex_unlock(&stream->mutex);
+
+		wait_event(stream->wait, !list_empty(&stream->idle));
+	}
+}
+
+
+static void put_decomp_stream(struct squashfs_sb_info *msblk,
+	struct decomp_stream *decomp_strm)
+{
+	struct squashfs_stream *stream = msblk->stream;
+
+	mutex_lock(&stream->mutex);
+	list_add(&decomp_strm->list, &stream->idle);
+	mutex_unlock(&stream->mutex);
+	wake_up(&stream->wait);
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct decomp_stream *decomp_strm = get_decomp_stream(msblk);
+	int res;
+
+	res = msblk->decompressor->decompress(msblk, decomp_strm->stream,
+		buffer, bh, b, offset, length, srclength, pages);
+	put_decomp_stream(msblk, decomp_strm);
+
+	return res;
+}
+
+
+/*
+ * Set up the stream pool, with room for up to max_streams streams, and
+ * allocate the first stream.
+ */
+struct squashfs_stream *squashfs_decompressor_init(struct super_block *sb,
+	unsigned short flags, int max_streams)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
-	void *strm, *buffer = NULL;
-	int length = 0;
+	struct squashfs_stream *stream;
+	struct decomp_stream *decomp_strm;
+	void *buffer = NULL;
+	int length = 0, err;
 
 	/*
 	 * Read decompressor specific options from file system if present
@@ -102,15 +233,59 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 			PAGE_CACHE_SIZE, 1);
 
 		if (length < 0) {
-			strm = ERR_PTR(length);
-			goto finished;
+			err = length;
+			goto failed;
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (stream == NULL) {
+		err = -ENOMEM;
+		goto failed;
+	}
+
+	stream->comp_opts = buffer;
+	stream->comp_opts_len = length;
+	mutex_init(&stream->mutex);
+	INIT_LIST_HEAD(&stream->idle);
+	init_waitqueue_head(&stream->wait);
+	stream->max_streams = max_streams;
+	msblk->stream = stream;
 
-finished:
+	decomp_strm = alloc_decomp_stream(msblk);
+	if (IS_ERR(decomp_strm)) {
+		msblk->stream = NULL;
+		kfree(stream);
+		err = PTR_ERR(decomp_strm);
+		goto failed;
+	}
+	list_add(&decomp_strm->list, &stream->idle);
+	stream->nr_streams = 1;
+
+	return stream;
+
+failed:
 	kfree(buffer);
+	return ERR_PTR(err);
+}
+
+
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream = msblk->stream;
+	struct decomp_stream *decomp_strm, *next;
+
+	if (stream == NULL)
+		return;
+
+	list_for_each_entry_safe(decomp_strm, next, &stream->idle, list) {
+		list_del(&decomp_strm->list);
+		free_decomp_stream(msblk, decomp_strm);
+		stream->nr_streams--;
+	}
+	WARN_ON(stream->nr_streams);
 
-	return strm;
+	kfree(stream->comp_opts);
+	kfree(stream);
+	msblk->stream = NULL;
 }
@@ -371,6 +371,82 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock straight into the page cache pages it covers,
+ * rather than into a read_page cache entry which is then copied out.
+ *
+ * This is only done if all the pages can be grabbed, none of them is
+ * already uptodate and all are directly addressable (not highmem), otherwise
+ * -EAGAIN is returned with only @target_page (still locked) held, and the
+ * caller falls back to the read_page cache.  On any other error all pages
+ * bar @target_page have been released.  On success all pages have been
+ * filled and unlocked, including @target_page.
+ */
+static int squashfs_readpage_direct(struct page *target_page, u64 block,
+	int bsize, int bytes)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int pages = (bytes + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	struct page **page;
+	void **pageaddr;
+	int i, res, avail, err = -EAGAIN;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	pageaddr = kcalloc(pages, sizeof(*pageaddr), GFP_KERNEL);
+	if (page == NULL || pageaddr == NULL)
+		goto out;
+
+	for (i = 0; i < pages; i++) {
+		page[i] = (start_index + i == target_page->index) ? target_page :
+			grab_cache_page_nowait(target_page->mapping,
+							start_index + i);
+
+		if (page[i] == NULL || PageUptodate(page[i]) ||
+						PageHighMem(page[i]))
+			goto release;
+
+		pageaddr[i] = page_address(page[i]);
+	}
+
+	res = squashfs_read_data(inode->i_sb, pageaddr, block, bsize, NULL,
+					pages << PAGE_CACHE_SHIFT, pages);
+	if (res < 0) {
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+		err = res;
+		goto release;
+	}
+
+	/* Zero whatever the datablock didn't fill */
+	for (i = 0; i < pages; i++, res -= PAGE_CACHE_SIZE) {
+		avail = clamp_t(int, res, 0, PAGE_CACHE_SIZE);
+		memset(pageaddr[i] + avail, 0, PAGE_CACHE_SIZE - avail);
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+	err = 0;
+	goto out;
+
+release:
+	for (i = 0; i < pages && page[i]; i++) {
+		if (page[i] == target_page)
+			continue;
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+out:
+	kfree(pageaddr);
+	kfree(page);
+	return err;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -410,8 +486,18 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock, directly into the
+			 * page cache if possible.
 			 */
+			int res = squashfs_readpage_direct(page, block, bsize,
+				index == file_end ?
+				(i_size_read(inode) & (msblk->block_size - 1)) :
+				 msblk->block_size);
+			if (res == 0)
+				return 0;
+			else if (res != -EAGAIN)
+				goto error_out;
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
@@ -36,6 +36,8 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/cpumask.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -74,6 +76,53 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+enum {
+	Opt_threads, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_threads, "threads=%u"},
+	{Opt_err, NULL}
+};
+
+/*
+ * threads=<n> sets how many blocks can be decompressed in parallel, it
+ * defaults to the number of online CPUs.
+ */
+static int squashfs_parse_options(char *options, int *threads)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int option;
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		int token;
+
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_threads:
+			if (match_int(&args[0], &option) || option < 1)
+				return -EINVAL;
+			/* no use in more streams than cpus to run them */
+			*threads = min_t(int, option, num_possible_cpus());
+			break;
+		default:
+			ERROR("Unrecognized mount option \"%s\" or missing "
+				"value\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -84,10 +133,19 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	unsigned short flags;
 	unsigned int fragments;
 	u64 lookup_table_start, xattr_id_table_start, next_table;
+	int threads = 0;
 	int err;
 
 	TRACE("Entered squashfs_fill_superblock\n");
 
+	save_mount_options(sb, data);
+
+	err = squashfs_parse_options(data, &threads);
+	if (err)
+		return err;
+	if (threads == 0)
+		threads = num_online_cpus();
+
 	sb->s_fs_info = kzalloc(sizeof(*msblk), GFP_KERNEL);
 	if (sb->s_fs_info == NULL) {
 		ERROR("Failed to allocate squashfs_sb_info\n");
@@ -98,7 +156,6 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
 	/*
@@ -200,14 +257,17 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
+	/*
+	 * Allocate read_page block: datablocks are decompressed straight
+	 * into the page cache, this is only the fallback path
+	 */
 	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
 	}
 
-	msblk->stream = squashfs_decompressor_init(sb, flags);
+	msblk->stream = squashfs_decompressor_init(sb, flags, threads);
 	if (IS_ERR(msblk->stream)) {
 		err = PTR_ERR(msblk->stream);
 		msblk->stream = NULL;
@@ -332,7 +392,7 @@ failed_mount:
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
-	squashfs_decompressor_free(msblk, msblk->stream);
+	squashfs_decompressor_free(msblk);
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
@@ -379,7 +439,7 @@ static void squashfs_put_super(struct super_block *sb)
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
-		squashfs_decompressor_free(sbi, sbi->stream);
+		squashfs_decompressor_free(sbi);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
@@ -487,7 +547,8 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
-	.remount_fs = squashfs_remount
+	.remount_fs = squashfs_remount,
+	.show_options = generic_show_options
 };
 
 module_init(init_squashfs_fs);
@@ -67,7 +67,7 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 		fs_objects = sb->s_op->nr_cached_objects(sb);
 
 	total_objects = sb->s_nr_dentry_unused +
-			sb->s_nr_inodes_unused + fs_objects + 1;
+			sb_nr_inodes_unused(sb) + fs_objects + 1;
 
 	if (sc->nr_to_scan) {
 		int	dentries;
@@ -76,7 +76,7 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 		/* proportion the scan between the caches */
 		dentries = (sc->nr_to_scan * sb->s_nr_dentry_unused) /
 							total_objects;
-		inodes = (sc->nr_to_scan * sb->s_nr_inodes_unused) /
+		inodes = (sc->nr_to_scan * sb_nr_inodes_unused(sb)) /
 							total_objects;
 		if (fs_objects)
 			fs_objects = (sc->nr_to_scan * fs_objects) /
@@ -93,7 +93,7 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 			fs_objects = sb->s_op->nr_cached_objects(sb);
 		}
 		total_objects = sb->s_nr_dentry_unused +
-				sb->s_nr_inodes_unused + fs_objects;
+				sb_nr_inodes_unused(sb) + fs_objects;
 	}
 
 	total_objects = (total_objects / 100) * sysctl_vfs_cache_pressure;
@@ -114,34 +114,38 @@ static struct super_block *alloc_super(struct file_system_type *type)
 	static const struct super_operations default_op;
 
 	if (s) {
-		if (security_sb_alloc(s)) {
-			kfree(s);
-			s = NULL;
-			goto out;
-		}
+		int i;
+
+		if (security_sb_alloc(s))
+			goto out_free_sb;
 #ifdef CONFIG_SMP
 		s->s_files = alloc_percpu(struct list_head);
-		if (!s->s_files) {
-			security_sb_free(s);
-			kfree(s);
-			s = NULL;
-			goto out;
-		} else {
-			int i;
-
-			for_each_possible_cpu(i)
-				INIT_LIST_HEAD(per_cpu_ptr(s->s_files, i));
-		}
+		if (!s->s_files)
+			goto out_free_security;
+		for_each_possible_cpu(i)
+			INIT_LIST_HEAD(per_cpu_ptr(s->s_files, i));
+
+		s->s_inodes = alloc_percpu(struct list_head);
+		if (!s->s_inodes)
+			goto out_free_files;
+		for_each_possible_cpu(i)
+			INIT_LIST_HEAD(per_cpu_ptr(s->s_inodes, i));
 #else
 		INIT_LIST_HEAD(&s->s_files);
+		INIT_LIST_HEAD(&s->s_inodes);
 #endif
+		s->s_inode_lru = kcalloc(nr_node_ids, sizeof(struct inode_lru),
+					 GFP_USER);
+		if (!s->s_inode_lru)
+			goto out_free_inodes;
+		for (i = 0; i < nr_node_ids; i++) {
+			spin_lock_init(&s->s_inode_lru[i].lock);
+			INIT_LIST_HEAD(&s->s_inode_lru[i].list);
+		}
 		s->s_bdi = &default_backing_dev_info;
 		INIT_LIST_HEAD(&s->s_instances);
 		INIT_HLIST_BL_HEAD(&s->s_anon);
-		INIT_LIST_HEAD(&s->s_inodes);
 		INIT_LIST_HEAD(&s->s_dentry_lru);
-		INIT_LIST_HEAD(&s->s_inode_lru);
-		spin_lock_init(&s->s_inode_lru_lock);
 		init_rwsem(&s->s_umount);
 		mutex_init(&s->s_lock);
 		lockdep_set_class(&s->s_umount, &type->s_umount_key);
@@ -184,8 +188,19 @@ static struct super_block *alloc_super(struct file_system_type *type)
 		s->s_shrink.shrink = prune_super;
 		s->s_shrink.batch = 1024;
 	}
-out:
 	return s;
+
+out_free_inodes:
+#ifdef CONFIG_SMP
+	free_percpu(s->s_inodes);
+out_free_files:
+	free_percpu(s->s_files);
+out_free_security:
+#endif
+	security_sb_free(s);
+out_free_sb:
+	kfree(s);
+	return NULL;
 }
 
 /**
@@ -198,7 +213,9 @@ static inline void destroy_super(struct super_block *s)
 {
 #ifdef CONFIG_SMP
 	free_percpu(s->s_files);
+	free_percpu(s->s_inodes);
 #endif
+	kfree(s->s_inode_lru);
 	security_sb_free(s);
 	kfree(s->s_subtype);
 	kfree(s->s_options);
@@ -385,14 +402,14 @@ void generic_shutdown_super(struct super_block *sb)
 		sync_filesystem(sb);
 		sb->s_flags &= ~MS_ACTIVE;
 
-		fsnotify_unmount_inodes(&sb->s_inodes);
+		fsnotify_unmount_inodes(sb);
 
 		evict_inodes(sb);
 
 		if (sop->put_super)
 			sop->put_super(sb);
 
-		if (!list_empty(&sb->s_inodes)) {
+		if (!sb_inode_list_empty(sb)) {
 			printk("VFS: Busy inodes after unmount of %s. "
 			   "Self-destruct in 5 seconds.  Have a nice day...\n",
 			   sb->s_id);
@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/llist.h>
 
 #include <linux/atomic.h>
 
@@ -34,6 +35,8 @@ struct kioctx;
 /* #define KIF_LOCKED		0 */
 #define KIF_KICKED		1
 #define KIF_CANCELLED		2
+/* iovecs hold kernel addresses of lowmem pages: in-kernel direct I/O */
+#define KIF_KERNEL_PAGES	3
 
 #define kiocbTryLock(iocb)	test_and_set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbTryKick(iocb)	test_and_set_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -123,6 +126,14 @@ struct kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/* queued on a page wait queue while a buffered read is retried */
+	struct wait_bit_queue	ki_wait;
+
+	/* completion state, queued on kioctx->complete_list */
+	struct llist_node	ki_llist;
+	long			ki_res;
+	long			ki_res2;
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -144,6 +155,15 @@ struct kiocb {
 #define AIO_RING_MAGIC			0xa10a10a1
 #define AIO_RING_COMPAT_FEATURES	1
 #define AIO_RING_INCOMPAT_FEATURES	0
+
+/*
+ * The ring is mapped at the address returned by io_setup() as the context
+ * id, so events that are already there can be reaped from userspace without
+ * a system call: read tail, copy the events from head up to tail, then move
+ * head forward with a compare-and-swap against the value it was read at.
+ * io_getevents() advances head the same way, so a failed swap means another
+ * reaper took the events first, and the copy must be redone.
+ */
 struct aio_ring {
 	unsigned	id;	/* kernel internal index number */
 	unsigned	nr;	/* number of io_events */
@@ -167,7 +187,6 @@ struct aio_ring_info {
 	unsigned long		mmap_size;
 
 	struct page		**ring_pages;
-	spinlock_t		ring_lock;
 	long			nr_pages;
 
 	unsigned		nr, tail;
@@ -180,9 +199,10 @@ struct kioctx {
 	int			dead;
 	struct mm_struct	*mm;
 
-	/* This needs improving */
 	unsigned long		user_id;
-	struct hlist_node	list;
+
+	/* index in mm->ioctx_table, also stored in the ring's id field */
+	unsigned		id;
 
 	wait_queue_head_t	wait;
 
@@ -197,6 +217,9 @@ struct kioctx {
 
 	struct aio_ring_info	ring_info;
 
+	/* completed kiocbs waiting to be moved into the ring */
+	struct llist_head	complete_list;
+
 	struct delayed_work	wq;
 
 	struct rcu_head		rcu_head;
@@ -26,6 +26,9 @@ struct scsi_ioctl_command;
 
 struct request_queue;
 struct elevator_queue;
+struct blk_mq_ops;
+struct blk_mq_ctx;
+struct blk_mq_hw_ctx;
 struct request_pm_state;
 struct blk_trace;
 struct request;
@@ -82,6 +85,7 @@ struct request {
 	struct call_single_data csd;
 
 	struct request_queue *q;
+	struct blk_mq_ctx *mq_ctx;
 
 	unsigned int cmd_flags;
 	enum rq_cmd_type_bits cmd_type;
@@ -286,6 +290,18 @@ struct request_queue {
 	dma_drain_needed_fn	*dma_drain_needed;
 	lld_busy_fn		*lld_busy_fn;
 
+	struct blk_mq_ops	*mq_ops;
+
+	unsigned int		*mq_map;
+
+	/* sw queues */
+	struct blk_mq_ctx __percpu	*queue_ctx;
+	unsigned int		nr_queues;
+
+	/* hw dispatch queues */
+	struct blk_mq_hw_ctx	**queue_hw_ctx;
+	unsigned int		nr_hw_queues;
+
 	/*
 	 * Dispatch queue sorting
 	 */
@@ -375,6 +391,13 @@ struct request_queue {
 	struct list_head	flush_data_in_flight;
 	struct request		flush_rq;
 
+	/* flush sequencing for blk-mq, see blk-flush.c */
+	struct list_head	mq_flush_list;
+	spinlock_t		mq_flush_lock;
+	struct work_struct	mq_flush_work;
+
+	struct list_head	all_q_node;
+
 	struct mutex		sysfs_lock;
 
 #if defined(CONFIG_BLK_DEV_BSG)
@@ -414,6 +437,9 @@ struct request_queue {
 				 (1 << QUEUE_FLAG_SAME_COMP)	|	\
 				 (1 << QUEUE_FLAG_ADD_RANDOM))
 
+#define QUEUE_FLAG_MQ_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
+				 (1 << QUEUE_FLAG_SAME_COMP))
+
 static inline int queue_is_locked(struct request_queue *q)
 {
 #ifdef CONFIG_SMP
@@ -868,6 +894,7 @@ extern void blk_put_queue(struct request_queue *);
 struct blk_plug {
 	unsigned long magic;
 	struct list_head list;
+	struct list_head mq_list;
 	struct list_head cb_list;
 	unsigned int should_sort;
 };
@@ -902,7 +929,9 @@ static inline bool blk_needs_flush_plug(struct task_struct *tsk)
 {
 	struct blk_plug *plug = tsk->plug;
 
-	return plug && (!list_empty(&plug->list) || !list_empty(&plug->cb_list));
+	return plug && (!list_empty(&plug->list) ||
+			!list_empty(&plug->mq_list) ||
+			!list_empty(&plug->cb_list));
 }
 
 /*
@@ -1143,6 +1172,8 @@ static inline void put_dev_sector(Sector p)
 
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
+int kblockd_schedule_delayed_work(struct request_queue *q,
+				  struct delayed_work *dwork, unsigned long delay);
 
 #ifdef CONFIG_BLK_CGROUP
 /*
@@ -774,6 +774,7 @@ struct inode {
 	struct timespec		i_mtime;
 	struct timespec		i_ctime;
 	unsigned int		i_blkbits;
+	unsigned int		i_hash_bucket;	/* inode_hashtable index of i_hash */
 	blkcnt_t		i_blocks;
 
 #ifdef __NEED_I_SIZE_ORDERED
@@ -787,7 +788,7 @@ struct inode {
 
 	unsigned long		dirtied_when;	/* jiffies of first dirtying */
 
-	struct hlist_node	i_hash;
+	struct hlist_bl_node	i_hash;
 	struct list_head	i_wb_list;	/* backing dev IO list */
 	struct list_head	i_lru;		/* inode LRU list */
 	struct list_head	i_sb_list;
@@ -796,6 +797,9 @@ struct inode {
 		struct rcu_head		i_rcu;
 	};
 	atomic_t		i_count;
+#ifdef CONFIG_SMP
+	int			i_sb_list_cpu;	/* cpu of our sb->s_inodes list */
+#endif
 	u64			i_version;
 	unsigned short          i_bytes;
 	atomic_t		i_dio_count;
@@ -828,7 +832,7 @@ struct inode {
 
 static inline int inode_unhashed(struct inode *inode)
 {
-	return hlist_unhashed(&inode->i_hash);
+	return hlist_bl_unhashed(&inode->i_hash);
 }
 
 /*
@@ -1377,6 +1381,16 @@ extern int send_sigurg(struct fown_struct *fown);
 extern struct list_head super_blocks;
 extern spinlock_t sb_lock;
 
+/*
+ * Per-node list of unused inodes.  An inode goes on the list of the node
+ * its memory is on, so that the lru lock and list stay node local.
+ */
+struct inode_lru {
+	spinlock_t		lock;
+	struct list_head	list;	/* unused inode lru */
+	int			nr_items;	/* # of inodes on list */
+} ____cacheline_aligned_in_smp;
+
 struct super_block {
 	struct list_head	s_list;		/* Keep this first */
 	dev_t			s_dev;		/* search index; _not_ kdev_t */
@@ -1401,7 +1415,11 @@ struct super_block {
 #endif
 	const struct xattr_handler **s_xattr;
 
+#ifdef CONFIG_SMP
+	struct list_head __percpu *s_inodes;	/* all inodes */
+#else
 	struct list_head	s_inodes;	/* all inodes */
+#endif
 	struct hlist_bl_head	s_anon;		/* anonymous dentries for (nfs) exporting */
 #ifdef CONFIG_SMP
 	struct list_head __percpu *s_files;
@@ -1412,10 +1430,8 @@ struct super_block {
 	struct list_head	s_dentry_lru;	/* unused dentry lru */
 	int			s_nr_dentry_unused;	/* # of dentry on lru */
 
-	/* s_inode_lru_lock protects s_inode_lru and s_nr_inodes_unused */
-	spinlock_t		s_inode_lru_lock ____cacheline_aligned_in_smp;
-	struct list_head	s_inode_lru;		/* unused inode lru */
-	int			s_nr_inodes_unused;	/* # of inodes on lru */
+	/* unused inode lru, one per node, indexed by nid */
+	struct inode_lru	*s_inode_lru;
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1622,6 +1638,12 @@ struct inode_operations {
 
 struct seq_file;
 
+/*
+ * Pass as the type to rw_copy_check_uvector() to validate the iovec
+ * array without checking that the buffers are accessible to us.
+ */
+#define CHECK_IOVEC_ONLY -1
+
 ssize_t rw_copy_check_uvector(int type, const struct iovec __user * uvector,
 				unsigned long nr_segs, unsigned long fast_segs,
 				struct iovec *fast_pointer,
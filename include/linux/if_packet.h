@@ -61,6 +61,17 @@ struct tpacket_stats {
 	unsigned int	tp_drops;
 };
 
+struct tpacket_stats_v3 {
+	unsigned int	tp_packets;
+	unsigned int	tp_drops;
+	unsigned int	tp_freeze_q_cnt;
+};
+
+union tpacket_stats_u {
+	struct tpacket_stats stats1;
+	struct tpacket_stats_v3 stats3;
+};
+
 struct tpacket_auxdata {
 	__u32		tp_status;
 	__u32		tp_len;
@@ -78,6 +89,7 @@ struct tpacket_auxdata {
 #define TP_STATUS_LOSING	0x4
 #define TP_STATUS_CSUMNOTREADY	0x8
 #define TP_STATUS_VLAN_VALID   0x10 /* auxdata has valid tp_vlan_tci */
+#define TP_STATUS_BLK_TMO	0x20 /* block was retired by the timer */
 
 /* Tx ring - header status */
 #define TP_STATUS_AVAILABLE	0x0
@@ -113,12 +125,84 @@ struct tpacket2_hdr {
 
 #define TPACKET2_HDRLEN		(TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) + sizeof(struct sockaddr_ll))
 
+struct tpacket_hdr_variant1 {
+	__u32	tp_rxhash;
+	__u32	tp_vlan_tci;
+};
+
+struct tpacket3_hdr {
+	__u32		tp_next_offset;
+	__u32		tp_sec;
+	__u32		tp_nsec;
+	__u32		tp_snaplen;
+	__u32		tp_len;
+	__u32		tp_status;
+	__u16		tp_mac;
+	__u16		tp_net;
+	/* pkt_hdr variants */
+	union {
+		struct tpacket_hdr_variant1 hv1;
+	};
+};
+
+#define TPACKET3_HDRLEN		(TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) + sizeof(struct sockaddr_ll))
+
+struct tpacket_bd_ts {
+	unsigned int ts_sec;
+	union {
+		unsigned int ts_usec;
+		unsigned int ts_nsec;
+	};
+};
+
+struct tpacket_hdr_v1 {
+	__u32	block_status;
+	__u32	num_pkts;
+	__u32	offset_to_first_pkt;
+
+	/* Number of valid bytes, including padding; <= tp_block_size */
+	__u32	blk_len;
+
+	/* Increases by one for every block handed to user space */
+	__aligned_u64	seq_num;
+
+	/*
+	 * Both timestamps are taken from packets, also when the block was
+	 * retired by the timer, so that the first packet of a block never
+	 * precedes the last packet of the previous one.  ts_last_pkt is the
+	 * time the block was retired only if it holds no packets.
+	 */
+	struct tpacket_bd_ts	ts_first_pkt, ts_last_pkt;
+};
+
+union tpacket_bd_header_u {
+	struct tpacket_hdr_v1 bh1;
+};
+
+struct tpacket_block_desc {
+	__u32 version;
+	__u32 offset_to_priv;
+	union tpacket_bd_header_u hdr;
+};
+
 enum tpacket_versions {
 	TPACKET_V1,
 	TPACKET_V2,
+	TPACKET_V3,
 };
 
 /*
+   Block structure (TPACKET_V3):
+
+   - struct tpacket_block_desc
+   - pad to TPACKET_ALIGNMENT=16
+   - Start+offset_to_priv: private area of tp_sizeof_priv bytes
+   - pad to TPACKET_ALIGNMENT=16
+   - Start+offset_to_first_pkt: first frame, laid out as below with a
+     struct tpacket3_hdr.  Frames are variable length and aligned to
+     TPACKET_ALIGNMENT=16.  tp_next_offset of each frame gives the
+     offset of the next one, it is 0 for the last frame in the block.
+
    Frame structure:
 
    - Start. Frame must be aligned to TPACKET_ALIGNMENT=16
@@ -138,6 +222,24 @@ struct tpacket_req {
 	unsigned int	tp_frame_nr;	/* Total number of frames */
 };
 
+struct tpacket_req3 {
+	unsigned int	tp_block_size;	/* Minimal size of contiguous block */
+	unsigned int	tp_block_nr;	/* Number of blocks */
+	unsigned int	tp_frame_size;	/* Size of frame */
+	unsigned int	tp_frame_nr;	/* Total number of frames */
+	unsigned int	tp_retire_blk_tov; /* timeout in msecs */
+	unsigned int	tp_sizeof_priv; /* offset to private data area */
+	unsigned int	tp_feature_req_word;
+};
+
+union tpacket_req_u {
+	struct tpacket_req	req;
+	struct tpacket_req3	req3;
+};
+
+/* tp_feature_req_word bits */
+#define TP_FT_REQ_FILL_RXHASH	0x1
+
 struct packet_mreq {
 	int		mr_ifindex;
 	unsigned short	mr_type;
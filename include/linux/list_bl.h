@@ -115,6 +115,15 @@ static inline void hlist_bl_del_init(struct hlist_bl_node *n)
 	}
 }
 
+/*
+ * Mark a node as hashed without putting it on any list, like
+ * hlist_add_fake().
+ */
+static inline void hlist_bl_add_fake(struct hlist_bl_node *n)
+{
+	n->pprev = &n->next;
+}
+
 static inline void hlist_bl_lock(struct hlist_bl_head *b)
 {
 	bit_spin_lock(0, (unsigned long *)b);
@@ -0,0 +1,39 @@
+#ifndef __LINUX_LOCKREF_H
+#define __LINUX_LOCKREF_H
+
+/*
+ * Locked reference counts.
+ *
+ * A spinlock and a reference count that share one 64-bit word.  The
+ * count is normally protected by the lock, but the common get and put
+ * operations are done with a single cmpxchg on the whole word as long
+ * as nobody holds the lock, so they don't have to take it.  Anyone
+ * holding the lock sees a stable count, since every lockless update
+ * fails once the lock word changes.
+ *
+ * This needs the architecture to fit a spinlock in 32 bits and to be
+ * able to tell an unlocked spinlock from its value
+ * (arch_spin_value_unlocked()); see ARCH_USE_CMPXCHG_LOCKREF.  Without
+ * it all the operations fall back to taking the spinlock.
+ */
+
+#include <linux/spinlock.h>
+
+struct lockref {
+	union {
+#ifdef CONFIG_CMPXCHG_LOCKREF
+		aligned_u64 lock_count;
+#endif
+		struct {
+			spinlock_t lock;
+			unsigned int count;
+		};
+	};
+};
+
+extern void lockref_get(struct lockref *);
+extern int lockref_get_not_zero(struct lockref *);
+extern int lockref_get_or_lock(struct lockref *);
+extern int lockref_put_or_lock(struct lockref *);
+
+#endif /* __LINUX_LOCKREF_H */
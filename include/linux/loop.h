@@ -64,6 +64,11 @@ struct loop_device {
 
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
+
+	/* LO_FLAGS_DIRECT_IO: backing file opened O_DIRECT, bios in flight */
+	struct file		*lo_dio_file;
+	atomic_t		lo_dio_inflight;
+	wait_queue_head_t	lo_dio_wait;
 };
 
 #endif /* __KERNEL__ */
@@ -75,6 +80,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_USE_AOPS	= 2,
 	LO_FLAGS_AUTOCLEAR	= 4,
+	LO_FLAGS_DIRECT_IO	= 16,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
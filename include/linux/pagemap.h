@@ -304,6 +304,8 @@ extern void __lock_page(struct page *page);
 extern int __lock_page_killable(struct page *page);
 extern int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 				unsigned int flags);
+extern int lock_page_async(struct page *page, struct wait_bit_queue *wait);
+extern void cancel_page_wait_async(struct wait_bit_queue *wait);
 extern void unlock_page(struct page *page);
 
 static inline void __set_page_locked(struct page *page)
@@ -91,6 +91,15 @@ static inline void prandom32_seed(struct rnd_state *state, u64 seed)
 	state->s3 = __seed(i, 15);
 }
 
+/*
+ * Cheap linear congruential generator, for callers that need a sequence
+ * of well spread values derived from a (hash) seed rather than randomness.
+ */
+static inline u32 next_pseudo_random32(u32 seed)
+{
+	return seed * 1664525 + 1013904223;
+}
+
 #endif /* __KERNEL___ */
 
 #endif /* _LINUX_RANDOM_H */
@@ -31,6 +31,7 @@ struct shmem_sb_info {
 	uid_t uid;		    /* Mount uid for root directory */
 	gid_t gid;		    /* Mount gid for root directory */
 	mode_t mode;		    /* Mount mode for root directory */
+	unsigned char huge;	    /* Whether to try for hugepages */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
 };
 
@@ -47,6 +48,8 @@ extern int shmem_fill_super(struct super_block *sb, void *data, int silent);
 extern struct file *shmem_file_setup(const char *name,
 					loff_t size, unsigned long flags);
 extern int shmem_zero_setup(struct vm_area_struct *);
+extern unsigned long shmem_get_unmapped_area(struct file *, unsigned long addr,
+		unsigned long len, unsigned long pgoff, unsigned long flags);
 extern int shmem_lock(struct file *file, int lock, struct user_struct *user);
 extern struct page *shmem_read_mapping_page_gfp(struct address_space *mapping,
 					pgoff_t index, gfp_t gfp_mask);
@@ -60,4 +63,24 @@ static inline struct page *shmem_read_mapping_page(
 					mapping_gfp_mask(mapping));
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#ifdef CONFIG_SHMEM
+extern struct kobj_attribute shmem_enabled_attr;
+extern bool shmem_huge_enabled(struct vm_area_struct *vma);
+extern int shmem_collapse_hugeblock(struct address_space *mapping,
+				    pgoff_t index, int max_none);
+#else
+static inline bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	return false;
+}
+
+static inline int shmem_collapse_hugeblock(struct address_space *mapping,
+					   pgoff_t index, int max_none)
+{
+	return -EINVAL;
+}
+#endif
+#endif
+
 #endif
@@ -24,7 +24,7 @@
 enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGALLOC),
 		PGFREE, PGACTIVATE, PGDEACTIVATE,
-		PGFAULT, PGMAJFAULT,
+		PGFAULT, PGMAJFAULT, PGFAULTAROUND, PGFAULTAROUND_MAPPED,
 		FOR_ALL_ZONES(PGREFILL),
 		FOR_ALL_ZONES(PGSTEAL),
 		FOR_ALL_ZONES(PGSCAN_KSWAPD),
@@ -57,6 +57,12 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		THP_COLLAPSE_ALLOC,
 		THP_COLLAPSE_ALLOC_FAILED,
 		THP_SPLIT,
+		THP_FILE_ALLOC,
+		THP_FILE_MAPPED,
+#endif
+#ifdef CONFIG_SWAP
+		SWAP_RA,	/* pages read by swap readahead */
+		SWAP_RA_HIT,	/* swap readahead pages later faulted in */
 #endif
 		NR_VM_EVENT_ITEMS
 };
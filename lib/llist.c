@@ -33,8 +33,10 @@
  * llist_add - add a new entry
  * @new:	new entry to be added
  * @head:	the head for your lock-less list
+ *
+ * Returns true if the list was empty prior to adding this entry.
  */
-void llist_add(struct llist_node *new, struct llist_head *head)
+bool llist_add(struct llist_node *new, struct llist_head *head)
 {
 	struct llist_node *entry, *old_entry;
 
@@ -48,6 +50,8 @@ void llist_add(struct llist_node *new, struct llist_head *head)
 		new->next = entry;
 		cpu_relax();
 	} while ((entry = cmpxchg(&head->first, old_entry, new)) != old_entry);
+
+	return old_entry == NULL;
 }
 EXPORT_SYMBOL_GPL(llist_add);
 
@@ -56,8 +60,10 @@ EXPORT_SYMBOL_GPL(llist_add);
  * @new_first:	first entry in batch to be added
  * @new_last:	last entry in batch to be added
  * @head:	the head for your lock-less list
+ *
+ * Returns true if the list was empty prior to adding the entries.
  */
-void llist_add_batch(struct llist_node *new_first, struct llist_node *new_last,
+bool llist_add_batch(struct llist_node *new_first, struct llist_node *new_last,
 		     struct llist_head *head)
 {
 	struct llist_node *entry, *old_entry;
@@ -72,6 +78,8 @@ void llist_add_batch(struct llist_node *new_first, struct llist_node *new_last,
 		new_last->next = entry;
 		cpu_relax();
 	} while ((entry = cmpxchg(&head->first, old_entry, new_first)) != old_entry);
+
+	return old_entry == NULL;
 }
 EXPORT_SYMBOL_GPL(llist_add_batch);
 
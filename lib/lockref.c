@@ -0,0 +1,143 @@
+/*
+ * Locked reference counts, see include/linux/lockref.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/lockref.h>
+
+#ifdef CONFIG_CMPXCHG_LOCKREF
+
+/*
+ * Try to do CODE on a copy of the lockref and install it with cmpxchg,
+ * for as long as the lock is seen unlocked.  cmpxchg64 returns the
+ * current value on failure, so that is where the next round starts.
+ * Falls through to the locked slow path if the lock is held.
+ */
+#define CMPXCHG_LOOP(CODE, SUCCESS) do {				\
+	struct lockref old;						\
+	BUILD_BUG_ON(sizeof(old) != 8);					\
+	old.lock_count = ACCESS_ONCE(lockref->lock_count);		\
+	while (likely(arch_spin_value_unlocked(old.lock.rlock.raw_lock))) { \
+		struct lockref new = old, prev = old;			\
+		CODE							\
+		old.lock_count = cmpxchg64(&lockref->lock_count,	\
+					   old.lock_count,		\
+					   new.lock_count);		\
+		if (likely(old.lock_count == prev.lock_count)) {	\
+			SUCCESS;					\
+		}							\
+		cpu_relax();						\
+	}								\
+} while (0)
+
+#else
+
+#define CMPXCHG_LOOP(CODE, SUCCESS) do { } while (0)
+
+#endif
+
+/**
+ * lockref_get - increment the reference count
+ * @lockref: pointer to lockref structure
+ *
+ * The caller must already hold a reference, or otherwise know that
+ * the count can't drop to zero under it.
+ */
+void lockref_get(struct lockref *lockref)
+{
+	CMPXCHG_LOOP(
+		new.count++;
+	,
+		return;
+	);
+
+	spin_lock(&lockref->lock);
+	lockref->count++;
+	spin_unlock(&lockref->lock);
+}
+EXPORT_SYMBOL(lockref_get);
+
+/**
+ * lockref_get_not_zero - increment the reference count unless it is zero
+ * @lockref: pointer to lockref structure
+ *
+ * Returns 1 if a reference was taken, 0 if the count was zero.
+ */
+int lockref_get_not_zero(struct lockref *lockref)
+{
+	int retval;
+
+	CMPXCHG_LOOP(
+		new.count++;
+		if (!old.count)
+			return 0;
+	,
+		return 1;
+	);
+
+	spin_lock(&lockref->lock);
+	retval = 0;
+	if (lockref->count) {
+		lockref->count++;
+		retval = 1;
+	}
+	spin_unlock(&lockref->lock);
+	return retval;
+}
+EXPORT_SYMBOL(lockref_get_not_zero);
+
+/**
+ * lockref_get_or_lock - increment the count or take the lock
+ * @lockref: pointer to lockref structure
+ *
+ * Returns 1 if a reference was taken.  Returns 0 with the lock held
+ * if the count was zero, for the caller to deal with.
+ */
+int lockref_get_or_lock(struct lockref *lockref)
+{
+	CMPXCHG_LOOP(
+		new.count++;
+		if (!old.count)
+			break;
+	,
+		return 1;
+	);
+
+	spin_lock(&lockref->lock);
+	if (!lockref->count)
+		return 0;
+	lockref->count++;
+	spin_unlock(&lockref->lock);
+	return 1;
+}
+EXPORT_SYMBOL(lockref_get_or_lock);
+
+/**
+ * lockref_put_or_lock - decrement the count unless it would drop to zero
+ * @lockref: pointer to lockref structure
+ *
+ * Returns 1 if the count was decremented.  Returns 0 with the lock held
+ * if this would have dropped the last reference, for the caller to do
+ * the final put under the lock.
+ */
+int lockref_put_or_lock(struct lockref *lockref)
+{
+	CMPXCHG_LOOP(
+		new.count--;
+		if (old.count <= 1)
+			break;
+	,
+		return 1;
+	);
+
+	spin_lock(&lockref->lock);
+	if (lockref->count <= 1)
+		return 0;
+	lockref->count--;
+	spin_unlock(&lockref->lock);
+	return 1;
+}
+EXPORT_SYMBOL(lockref_put_or_lock);
@@ -632,6 +632,75 @@ int __lock_page_killable(struct page *page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/**
+ * lock_page_async - lock a page without sleeping, for retry-based AIO
+ * @page: the page to lock
+ * @wait: the kiocb's wait entry, or NULL
+ *
+ * Like lock_page_killable(), but if the page is locked @wait is queued
+ * on the page's wait queue and -EIOCBRETRY is returned instead of
+ * sleeping.  The wait entry's function kicks the kiocb for another
+ * retry when the page is unlocked.  With a NULL @wait this is just
+ * lock_page_killable().
+ */
+int lock_page_async(struct page *page, struct wait_bit_queue *wait)
+{
+	wait_queue_head_t *q;
+	unsigned long flags;
+
+	if (!wait)
+		return lock_page_killable(page);
+
+	if (trylock_page(page))
+		return 0;
+
+	/* the entry may still sit on the queue of a page we waited on */
+	cancel_page_wait_async(wait);
+
+	q = page_waitqueue(page);
+	spin_lock_irqsave(&q->lock, flags);
+	wait->key.flags = &page->flags;
+	wait->key.bit_nr = PG_locked;
+	__add_wait_queue(q, &wait->wait);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	/*
+	 * Recheck now that we are queued: unlock_page() takes the queue
+	 * lock to wake us, so either it sees our entry or we see the page
+	 * unlocked here.
+	 */
+	if (trylock_page(page)) {
+		cancel_page_wait_async(wait);
+		return 0;
+	}
+	return -EIOCBRETRY;
+}
+EXPORT_SYMBOL_GPL(lock_page_async);
+
+/**
+ * cancel_page_wait_async - dequeue a wait entry queued by lock_page_async()
+ * @wait: the kiocb's wait entry
+ *
+ * Must be called before the kiocb completes, so that a later unlock of
+ * the page doesn't kick a freed kiocb.  Taking the queue lock also waits
+ * for a wake up that is running the entry's function right now.
+ */
+void cancel_page_wait_async(struct wait_bit_queue *wait)
+{
+	wait_queue_head_t *q;
+	unsigned long flags;
+
+	if (!wait->key.flags)
+		return;
+
+	q = page_waitqueue(container_of(wait->key.flags, struct page, flags));
+	spin_lock_irqsave(&q->lock, flags);
+	list_del_init(&wait->wait.task_list);
+	spin_unlock_irqrestore(&q->lock, flags);
+	wait->key.flags = NULL;
+}
+EXPORT_SYMBOL_GPL(cancel_page_wait_async);
+
 int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 			 unsigned int flags)
 {
@@ -1080,6 +1149,7 @@ static void shrink_readahead_size_eio(struct file *filp,
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @wait:	wait entry of an async kiocb, or NULL to sleep on locked pages
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
@@ -1088,7 +1158,8 @@ static void shrink_readahead_size_eio(struct file *filp,
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct wait_bit_queue *wait)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1207,8 +1278,12 @@ page_ok:
 		goto out;
 
 page_not_up_to_date:
-		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		/*
+		 * Get exclusive access to the page ...  An AIO retry does
+		 * not wait here: it returns -EIOCBRETRY with what it read so
+		 * far and is kicked again when the page gets unlocked.
+		 */
+		error = lock_page_async(page, wait);
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -1245,7 +1320,7 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			error = lock_page_async(page, wait);
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -1268,7 +1343,10 @@ readpage:
 		goto page_ok;
 
 readpage_error:
-		/* UHHUH! A synchronous read error occurred. Report it */
+		/*
+		 * UHHUH! A synchronous read error occurred. Report it.
+		 * (or -EIOCBRETRY, the read has to be retried later)
+		 */
 		desc->error = error;
 		page_cache_release(page);
 		goto out;
@@ -1400,6 +1478,7 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 	unsigned long seg = 0;
 	size_t count;
 	loff_t *ppos = &iocb->ki_pos;
+	struct wait_bit_queue *wait = NULL;
 	struct blk_plug plug;
 
 	count = 0;
@@ -1407,6 +1486,14 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 	if (retval)
 		return retval;
 
+	/*
+	 * An async kiocb does not sleep on pages under I/O: its wait entry
+	 * is queued on the page instead, and the aio code retries the read
+	 * once the page is unlocked.
+	 */
+	if (!is_sync_kiocb(iocb))
+		wait = &iocb->ki_wait;
+
 	blk_start_plug(&plug);
 
 	/* coalesce the iovecs and go direct-to-BIO for O_DIRECT */
@@ -1471,7 +1558,7 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor, wait);
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
@@ -1759,8 +1846,103 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map already cached pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	range to map: vmf->pgoff to vmf->max_pgoff, with vmf->pte and
+ *		vmf->virtual_address corresponding to vmf->pgoff
+ *
+ * Called with the page table lock held, so this never sleeps nor starts
+ * I/O: pages which are not in the page cache, not uptodate, locked or
+ * beyond EOF are simply left for a real fault to bring in.
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	unsigned long address = (unsigned long) vmf->virtual_address;
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t index = vmf->pgoff;
+	unsigned int i, nr_found;
+	unsigned long nr_mapped = 0;
+	struct page *page;
+	loff_t size;
+	pte_t *pte;
+
+	rcu_read_lock();
+	while (index <= vmf->max_pgoff) {
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+				slots, indices, index,
+				min_t(pgoff_t, PAGEVEC_SIZE,
+				      vmf->max_pgoff - index + 1));
+		if (!nr_found)
+			break;
+
+		for (i = 0; i < nr_found; i++) {
+			if (indices[i] > vmf->max_pgoff)
+				goto out;
+repeat:
+			page = radix_tree_deref_slot(slots[i]);
+			if (unlikely(!page))
+				continue;
+			if (radix_tree_exception(page)) {
+				/* it's only an optimisation: don't restart */
+				if (radix_tree_deref_retry(page))
+					goto out;
+				continue;
+			}
+
+			if (!page_cache_get_speculative(page))
+				goto repeat;
+
+			/* Has the page moved? */
+			if (unlikely(page != *slots[i])) {
+				page_cache_release(page);
+				goto repeat;
+			}
+
+			if (!PageUptodate(page) || PageReadahead(page) ||
+			    PageHWPoison(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+
+			size = i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1;
+			if (page->index >= size >> PAGE_CACHE_SHIFT)
+				goto unlock;
+
+			pte = vmf->pte + page->index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (file->f_ra.mmap_miss > 0)
+				file->f_ra.mmap_miss--;
+			do_set_pte(vma, address +
+				   ((page->index - vmf->pgoff) << PAGE_SHIFT),
+				   page, pte, false, false);
+			unlock_page(page);
+			nr_mapped++;
+			continue;
+unlock:
+			unlock_page(page);
+skip:
+			page_cache_release(page);
+		}
+		index = indices[nr_found - 1] + 1;
+	}
+out:
+	rcu_read_unlock();
+	count_vm_events(PGFAULTAROUND_MAPPED, nr_mapped);
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
@@ -17,6 +17,8 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/file.h>
+#include <linux/shmem_fs.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -316,6 +318,9 @@ static struct attribute *hugepage_attr[] = {
 	&defrag_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -717,6 +722,80 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * Map the HPAGE_PMD_NR pagecache pages starting at @page with a
+ * single huge pmd. Unlike anonymous hugepages they are not compound:
+ * each page keeps its own refcount, mapcount, radix tree slot and lru
+ * position, so once the pmd is split truncation, reclaim and swap
+ * deal with them as with any other small pages. The caller passes in
+ * one reference on each page, which the pmd inherits; they are all
+ * dropped if the pmd can't be established.
+ */
+int do_huge_pmd_file_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			  unsigned long address, pmd_t *pmd,
+			  struct page *page, unsigned int flags)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	pgoff_t pgoff;
+	pmd_t entry;
+	int i, locked = 0;
+
+	VM_BUG_ON(haddr < vma->vm_start ||
+		  haddr + HPAGE_PMD_SIZE > vma->vm_end);
+	pgoff = ((haddr - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		goto out_put;
+
+	/*
+	 * Like __do_fault() we rely on the page lock to keep truncation
+	 * and writeout away while the mapping is established, only for
+	 * the whole block: taken in index order as truncation does.
+	 */
+	for (; locked < HPAGE_PMD_NR; locked++) {
+		lock_page(page + locked);
+		if (unlikely(page[locked].mapping != mapping ||
+			     page[locked].index != pgoff + locked ||
+			     !PageUptodate(page + locked))) {
+			locked++;
+			goto out_unlock;
+		}
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		goto out_unlock;
+	}
+	entry = mk_pmd(page, vma->vm_page_prot);
+	if (flags & FAULT_FLAG_WRITE)
+		entry = pmd_mkdirty(entry);
+	entry = pmd_mkhuge(entry);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(page + i);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	spin_unlock(&mm->page_table_lock);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		unlock_page(page + i);
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+
+out_unlock:
+	for (i = 0; i < locked; i++)
+		unlock_page(page + i);
+	pte_free(mm, pgtable);
+out_put:
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		put_page(page + i);
+	return VM_FAULT_FALLBACK;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -750,6 +829,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* shared pagecache is refilled by the child's faults */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -888,6 +973,15 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct page *page, *new_page;
 	unsigned long haddr;
 
+	if (vma->vm_ops) {
+		/*
+		 * Pagecache is never copied on write: let the ptes
+		 * take the write fault.
+		 */
+		__split_huge_page_pmd(vma, address, pmd);
+		return 0;
+	}
+
 	VM_BUG_ON(!vma->anon_vma);
 	spin_lock(&mm->page_table_lock);
 	if (unlikely(!pmd_same(*pmd, orig_pmd)))
@@ -972,7 +1066,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	VM_BUG_ON(PageAnon(page) && !PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -987,7 +1081,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
+	VM_BUG_ON(!PageCompound(page) && PageAnon(page));
 	if (flags & FOLL_GET)
 		get_page_foll(page);
 
@@ -995,8 +1089,27 @@ out:
 	return page;
 }
 
+static void zap_huge_pagecache_pmd(struct mmu_gather *tlb,
+				   struct vm_area_struct *vma,
+				   pmd_t orig_pmd)
+{
+	struct page *page = pmd_page(orig_pmd);
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++, page++) {
+		if (pmd_dirty(orig_pmd))
+			set_page_dirty(page);
+		if (pmd_young(orig_pmd) &&
+		    likely(!VM_SequentialReadHint(vma)))
+			mark_page_accessed(page);
+		page_remove_rmap(page);
+		VM_BUG_ON(page_mapcount(page) < 0);
+		tlb_remove_page(tlb, page);
+	}
+}
+
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
-		 pmd_t *pmd)
+		 pmd_t *pmd, unsigned long addr)
 {
 	int ret = 0;
 
@@ -1011,6 +1124,19 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			pgtable_t pgtable;
 			pgtable = get_pmd_huge_pte(tlb->mm);
 			page = pmd_page(*pmd);
+			if (!PageAnon(page)) {
+				pmd_t orig_pmd;
+
+				/* atomic, to not lose the dirty bit */
+				orig_pmd = pmdp_get_and_clear(tlb->mm, addr,
+							      pmd);
+				add_mm_counter(tlb->mm, MM_FILEPAGES,
+					       -HPAGE_PMD_NR);
+				spin_unlock(&tlb->mm->page_table_lock);
+				zap_huge_pagecache_pmd(tlb, vma, orig_pmd);
+				pte_free(tlb->mm, pgtable);
+				return 1;
+			}
 			pmd_clear(pmd);
 			page_remove_rmap(page);
 			VM_BUG_ON(page_mapcount(page) < 0);
@@ -1123,6 +1249,57 @@ out:
 	return ret;
 }
 
+/*
+ * Return the pmd covering @address, if a page table is populated down
+ * to that level.
+ */
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Pagecache pages are never compound, but they can still be mapped by
+ * a huge pmd: check whether @page is, at @address in @vma, and return
+ * the pmd with the page_table_lock held if so.
+ */
+pmd_t *page_check_address_pagecache_pmd(struct page *page,
+					struct vm_area_struct *vma,
+					unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pmd_t *pmd;
+
+	if (PageAnon(page) || !vma_huge_pagecache(vma))
+		return NULL;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_trans_huge(*pmd))
+		return NULL;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd)) &&
+	    pmd_page(*pmd) + ((address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT) == page)
+		return pmd;
+	spin_unlock(&mm->page_table_lock);
+	return NULL;
+}
+
 static int __split_huge_page_splitting(struct page *page,
 				       struct vm_area_struct *vma,
 				       unsigned long address)
@@ -1429,12 +1606,18 @@ out:
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	unsigned long no_thp = VM_NO_THP;
+
+	/* shared pagecache can be mapped by huge pmds too */
+	if (vma_huge_pagecache(vma))
+		no_thp &= ~(VM_SHARED | VM_MAYSHARE);
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_HUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_HUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
@@ -1450,7 +1633,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_NOHUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_NOHUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -1578,20 +1761,27 @@ int __khugepaged_enter(struct mm_struct *mm)
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma)
 {
 	unsigned long hstart, hend;
-	if (!vma->anon_vma)
+	if (vma->vm_ops) {
 		/*
-		 * Not yet faulted in so we will register later in the
-		 * page fault if needed.
+		 * Of the file and special mappings khugepaged only
+		 * works on the shared pagecache of shmem.
 		 */
-		return 0;
-	if (vma->vm_ops)
-		/* khugepaged not yet working on file or special mappings */
-		return 0;
-	/*
-	 * If is_pfn_mapping() is true is_learn_pfn_mapping() must be
-	 * true too, verify it here.
-	 */
-	VM_BUG_ON(is_linear_pfn_mapping(vma) || vma->vm_flags & VM_NO_THP);
+		if (!shmem_huge_enabled(vma))
+			return 0;
+	} else {
+		if (!vma->anon_vma)
+			/*
+			 * Not yet faulted in so we will register later
+			 * in the page fault if needed.
+			 */
+			return 0;
+		/*
+		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
+		 * must be true too, verify it here.
+		 */
+		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
+			  vma->vm_flags & VM_NO_THP);
+	}
 	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 	hend = vma->vm_end & HPAGE_PMD_MASK;
 	if (hstart < hend)
@@ -2037,6 +2227,89 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
+/*
+ * Once a range of shared pagecache has been collapsed into a hugepage,
+ * the page tables that mapped the old pages are empty or map the new
+ * pages by pte: retract them from every mm that can take the mmap_sem
+ * right away, so that the next fault there maps the range with a pmd.
+ */
+static void retract_page_tables(struct address_space *mapping,
+				pgoff_t pgoff)
+{
+	struct vm_area_struct *vma;
+	struct prio_tree_iter iter;
+
+	mutex_lock(&mapping->i_mmap_mutex);
+	vma_prio_tree_foreach(vma, &iter, &mapping->i_mmap, pgoff, pgoff) {
+		struct mm_struct *mm = vma->vm_mm;
+		unsigned long addr;
+		pmd_t *pmd, _pmd;
+
+		/* the page table may hold private copies of the pages */
+		if (vma->anon_vma || !shmem_huge_enabled(vma))
+			continue;
+		addr = vma->vm_start + ((pgoff - vma->vm_pgoff) << PAGE_SHIFT);
+		if (addr & ~HPAGE_PMD_MASK ||
+		    addr + HPAGE_PMD_SIZE > vma->vm_end)
+			continue;
+		pmd = mm_find_pmd(mm, addr);
+		if (!pmd || pmd_trans_huge(*pmd))
+			continue;
+		/*
+		 * The mmap_sem held for writing keeps the faults, which
+		 * would fill the page table again, out of the range.
+		 */
+		if (!down_write_trylock(&mm->mmap_sem))
+			continue;
+		if (!khugepaged_test_exit(mm)) {
+			zap_page_range(vma, addr, HPAGE_PMD_SIZE, NULL);
+			spin_lock(&mm->page_table_lock);
+			_pmd = pmdp_clear_flush_notify(vma, addr, pmd);
+			mm->nr_ptes--;
+			spin_unlock(&mm->page_table_lock);
+			pte_free(mm, pmd_pgtable(_pmd));
+		}
+		up_write(&mm->mmap_sem);
+	}
+	mutex_unlock(&mapping->i_mmap_mutex);
+}
+
+/*
+ * Shared pagecache is collapsed in the pagecache itself rather than
+ * in the page tables of one mm. Returns 1 if it released the mmap_sem.
+ */
+static int khugepaged_scan_file(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct file *file;
+	pgoff_t pgoff;
+	pmd_t *pmd;
+	int ret;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	/* nothing to gain where this mm is not mapping small pages */
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || pmd_trans_huge(*pmd))
+		return 0;
+
+	pgoff = ((address - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	file = vma->vm_file;
+	get_file(file);
+	up_read(&mm->mmap_sem);
+
+	ret = shmem_collapse_hugeblock(file->f_mapping, pgoff,
+				       khugepaged_max_ptes_none);
+	if (ret >= 0)
+		retract_page_tables(file->f_mapping, pgoff);
+	if (ret > 0)
+		khugepaged_pages_collapsed++;
+
+	fput(file);
+	return 1;
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 {
@@ -2075,23 +2348,27 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
+		if (vma->vm_ops ? !shmem_huge_enabled(vma) :
+		    (!(vma->vm_flags & VM_HUGEPAGE) &&
 		     !khugepaged_always()) ||
 		    (vma->vm_flags & VM_NOHUGEPAGE)) {
 		skip:
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
-			goto skip;
-		if (is_vma_temporary_stack(vma))
-			goto skip;
-		/*
-		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
-		 * must be true too, verify it here.
-		 */
-		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
+		if (!vma->vm_ops) {
+			if (!vma->anon_vma)
+				goto skip;
+			if (is_vma_temporary_stack(vma))
+				goto skip;
+			/*
+			 * If is_pfn_mapping() is true
+			 * is_learn_pfn_mapping() must be true too,
+			 * verify it here.
+			 */
+			VM_BUG_ON(is_linear_pfn_mapping(vma) ||
+				  vma->vm_flags & VM_NO_THP);
+		}
 
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -2112,9 +2389,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (vma->vm_ops)
+				ret = khugepaged_scan_file(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2315,8 +2596,62 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+/*
+ * Pagecache mapped by a huge pmd is made of small pages already, so
+ * splitting only has to replace the pmd with the deposited page table
+ * filled with ptes. Called with the page_table_lock held, which is
+ * all the serialization needed against faults and other splitters:
+ * this runs from truncation and rmap walks without the mmap_sem.
+ */
+static void __split_huge_pagecache_pmd(struct vm_area_struct *vma,
+				       unsigned long haddr, pmd_t *pmd)
 {
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t orig_pmd, _pmd;
+	int i;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	/*
+	 * Clear the pmd atomically so the dirty bit can't be lost, and
+	 * flush it before the ptes become visible: small and huge TLB
+	 * entries for the same address must never coexist.
+	 */
+	orig_pmd = pmdp_get_and_clear(mm, haddr, pmd);
+	flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+
+	page = pmd_page(orig_pmd);
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		unsigned long addr = haddr + i * PAGE_SIZE;
+		pte_t *pte, entry;
+
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (!pmd_write(orig_pmd))
+			entry = pte_wrprotect(entry);
+		if (pmd_dirty(orig_pmd))
+			entry = pte_mkdirty(entry);
+		if (!pmd_young(orig_pmd))
+			entry = pte_mkold(entry);
+		pte = pte_offset_map(&_pmd, addr);
+		BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, addr, pte, entry);
+		pte_unmap(pte);
+	}
+
+	mm->nr_ptes++;
+	smp_wmb(); /* make pte visible before pmd */
+	pmd_populate(mm, pmd, pgtable);
+}
+
+void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -2325,6 +2660,11 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		__split_huge_pagecache_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -2335,31 +2675,53 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
-				    unsigned long address)
+/*
+ * For the pagetable walkers that only have the mm at hand; the
+ * mmap_sem must be held for the vma lookup.
+ */
+void split_huge_page_pmd_mm(struct mm_struct *mm, unsigned long address,
+			    pmd_t *pmd)
 {
-	pgd_t *pgd;
-	pud_t *pud;
-	pmd_t *pmd;
-
-	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
+	struct vm_area_struct *vma;
 
-	pgd = pgd_offset(mm, address);
-	if (!pgd_present(*pgd))
+	if (likely(!pmd_trans_huge(*pmd)))
 		return;
+	vma = find_vma(mm, address);
+	BUG_ON(!vma || vma->vm_start > address);
+	__split_huge_page_pmd(vma, address, pmd);
+}
 
-	pud = pud_offset(pgd, address);
-	if (!pud_present(*pud))
-		return;
+void split_huge_page_address(struct vm_area_struct *vma,
+			     unsigned long address)
+{
+	pmd_t *pmd;
 
-	pmd = pmd_offset(pud, address);
-	if (!pmd_present(*pmd))
+	pmd = mm_find_pmd(vma->vm_mm, address);
+	if (!pmd)
 		return;
 	/*
-	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
-	 * materialize from under us.
+	 * Either the caller holds the mmap_sem write mode, so a huge
+	 * pmd cannot materialize from under us, or it holds the
+	 * i_mmap_mutex and only cares about the pagecache pmds that
+	 * may already map its page.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd(vma, address, pmd);
+}
+
+/*
+ * Called with the mmap_sem held for writing when @vma turns nonlinear:
+ * the rmap of nonlinear vmas only knows about ptes.
+ */
+void split_huge_page_vma(struct vm_area_struct *vma)
+{
+	unsigned long addr;
+
+	for (addr = ALIGN(vma->vm_start, HPAGE_PMD_SIZE);
+	     addr + HPAGE_PMD_SIZE <= vma->vm_end;
+	     addr += HPAGE_PMD_SIZE) {
+		split_huge_page_address(vma, addr);
+		cond_resched();
+	}
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -2375,7 +2737,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (start & ~HPAGE_PMD_MASK &&
 	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, start);
+		split_huge_page_address(vma, start);
 
 	/*
 	 * If the new end address isn't hpage aligned and it could
@@ -2385,7 +2747,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (end & ~HPAGE_PMD_MASK &&
 	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, end);
+		split_huge_page_address(vma, end);
 
 	/*
 	 * If we're also updating the vma->vm_next->vm_start, if the new
@@ -2399,6 +2761,6 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 		if (nstart & ~HPAGE_PMD_MASK &&
 		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
 		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
-			split_huge_page_address(next->vm_mm, nstart);
+			split_huge_page_address(next, nstart);
 	}
 }
@@ -28,7 +28,7 @@
 #include <linux/kthread.h>
 #include <linux/wait.h>
 #include <linux/slab.h>
-#include <linux/rbtree.h>
+#include <linux/vmalloc.h>
 #include <linux/memory.h>
 #include <linux/mmu_notifier.h>
 #include <linux/swap.h>
@@ -69,11 +69,12 @@
  *    memory areas, and then the tree is rebuilt again from the beginning.
  * 2) KSM will only insert into the unstable tree, pages whose hash value
  *    has not changed since the previous scan of all memory areas.
- * 3) The unstable tree is a RedBlack Tree - so its balancing is based on the
- *    colors of the nodes and not on their contents, assuring that even when
- *    the tree gets "corrupted" it won't get out of balance, so scanning time
- *    remains the same (also, searching and inserting nodes in an rbtree uses
- *    the same algorithm, so we have no overhead when we flush and rebuild).
+ * 3) Both trees are hash tables indexed by page checksum (and by NUMA node
+ *    when merging across nodes is disabled), so a page is only compared
+ *    byte by byte against pages with the same checksum: most candidates
+ *    are rejected without any memcmp at all.  A page whose contents change
+ *    after insertion into the unstable tree just sits in the wrong bucket,
+ *    where it can't do any harm, until the tree is flushed.
  * 4) KSM never flushes the stable tree, which means that even if it were to
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
@@ -111,15 +112,19 @@ struct ksm_scan {
 };
 
 /**
- * struct stable_node - node of the stable rbtree
- * @node: rb node of this ksm page in the stable tree
+ * struct stable_node - node of the stable tree
+ * @node: link into the stable tree hash chain of this ksm page
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of this ksm page, which is the stable tree hash key
+ * @nid: NUMA node of this ksm page when it was inserted
  */
 struct stable_node {
-	struct rb_node node;
+	struct hlist_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
+	int nid;
 };
 
 /**
@@ -129,7 +134,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
- * @node: rb node of this rmap_item in the unstable tree
+ * @nid: NUMA node of the page, when in the unstable tree
+ * @node: link into the unstable tree hash chain of this rmap_item
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
  */
@@ -139,8 +145,9 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	int nid;			/* when node of unstable tree */
 	union {
-		struct rb_node node;	/* when node of unstable tree */
+		struct hlist_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
 			struct stable_node *head;
 			struct hlist_node hlist;
@@ -152,9 +159,13 @@ struct rmap_item {
 #define UNSTABLE_FLAG	0x100	/* is a node of the unstable tree */
 #define STABLE_FLAG	0x200	/* is listed from the stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+/* The stable and unstable tree hash tables, of 1 << ksm_hash_shift heads */
+static struct hlist_head *stable_tree_hash;
+static struct hlist_head *unstable_tree_hash;
+static unsigned int ksm_hash_shift;
+
+#define KSM_HASH_SHIFT_MIN	10
+#define KSM_HASH_SHIFT_MAX	18
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
@@ -189,6 +200,36 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Checksums sample this many KSM_CHECKSUM_CHUNK sized chunks of a page */
+#define KSM_CHECKSUM_CHUNK	64
+static unsigned int ksm_checksum_chunks = PAGE_SIZE / KSM_CHECKSUM_CHUNK / 4;
+
+#ifdef CONFIG_NUMA
+/* Zeroed when merging is only allowed within the same NUMA node */
+static unsigned int ksm_merge_across_nodes = 1;
+#else
+#define ksm_merge_across_nodes	1U
+#endif
+
+/**
+ * struct ksm_pass_stats - cost of a full scan
+ * @pages_scanned: pages looked at by cmp_and_merge_page
+ * @page_compares: full page comparisons
+ * @hash_rejects: tree searches that found no page with the same checksum
+ * @scan_ns: time spent by ksmd scanning
+ */
+struct ksm_pass_stats {
+	unsigned long pages_scanned;
+	unsigned long page_compares;
+	unsigned long hash_rejects;
+	u64 scan_ns;
+};
+
+/* The full scan in progress, and the last completed one */
+static struct ksm_pass_stats ksm_pass;
+static struct ksm_pass_stats ksm_last_pass;
+static u64 ksm_scan_clock;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -226,6 +267,31 @@ out:
 	return -ENOMEM;
 }
 
+static int __init ksm_hash_init(void)
+{
+	unsigned long size;
+
+	/* Around one hash head for every 16 pages of memory */
+	ksm_hash_shift = clamp_t(int, ilog2(totalram_pages) - 4,
+				 KSM_HASH_SHIFT_MIN, KSM_HASH_SHIFT_MAX);
+	size = sizeof(struct hlist_head) << ksm_hash_shift;
+
+	stable_tree_hash = vzalloc(size);
+	unstable_tree_hash = vzalloc(size);
+	if (!stable_tree_hash || !unstable_tree_hash) {
+		vfree(stable_tree_hash);
+		vfree(unstable_tree_hash);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void __init ksm_hash_free(void)
+{
+	vfree(stable_tree_hash);
+	vfree(unstable_tree_hash);
+}
+
 static void __init ksm_slab_free(void)
 {
 	kmem_cache_destroy(mm_slot_cache);
@@ -458,7 +524,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 		cond_resched();
 	}
 
-	rb_erase(&stable_node->node, &root_stable_tree);
+	hlist_del(&stable_node->node);
 	free_stable_node(stable_node);
 }
 
@@ -547,16 +613,16 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 	} else if (rmap_item->address & UNSTABLE_FLAG) {
 		unsigned char age;
 		/*
-		 * Usually ksmd can and must skip the rb_erase, because
-		 * root_unstable_tree was already reset to RB_ROOT.
-		 * But be careful when an mm is exiting: do the rb_erase
+		 * Usually ksmd can and must skip the hlist_del, because
+		 * unstable_tree_hash was already reset to empty.
+		 * But be careful when an mm is exiting: do the hlist_del
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
 		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			hlist_del(&rmap_item->node);
 
 		ksm_pages_unshared--;
 		rmap_item->address &= PAGE_MASK;
@@ -669,11 +735,21 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only samples ksm_checksum_chunks evenly spaced chunks of
+ * the page: it is used to spot pages which are changing, and as the hash
+ * key of the trees, neither of which needs to see every byte.  Merging
+ * always compares the whole page before going ahead.
+ */
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
+	unsigned int stride = PAGE_SIZE / ksm_checksum_chunks;
+	unsigned int offset;
+	u32 checksum = 17;
 	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	for (offset = 0; offset < PAGE_SIZE; offset += stride)
+		checksum = jhash2(addr + offset, KSM_CHECKSUM_CHUNK / 4,
+				  checksum);
 	kunmap_atomic(addr, KM_USER0);
 	return checksum;
 }
@@ -683,6 +759,7 @@ static int memcmp_pages(struct page *page1, struct page *page2)
 	char *addr1, *addr2;
 	int ret;
 
+	ksm_pass.page_compares++;
 	addr1 = kmap_atomic(page1, KM_USER0);
 	addr2 = kmap_atomic(page2, KM_USER1);
 	ret = memcmp(addr1, addr2, PAGE_SIZE);
@@ -974,19 +1051,37 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
 	return err ? NULL : page;
 }
 
+/*
+ * The node a page is accounted to for merging: pages are only merged with
+ * pages of the same node when merging across nodes is disabled.
+ */
+static inline int ksm_page_nid(struct page *page)
+{
+	return ksm_merge_across_nodes ? 0 : page_to_nid(page);
+}
+
+static inline struct hlist_head *ksm_hash_head(struct hlist_head *hash,
+					       u32 checksum, int nid)
+{
+	return &hash[hash_32(checksum + nid, ksm_hash_shift)];
+}
+
 /*
  * stable_tree_search - search for page inside the stable tree
  *
  * This function checks if there is a page inside the stable tree
  * with identical content to the page that we are scanning right now.
+ * Only ksm pages with the same checksum need to be compared with it.
  *
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
 	struct stable_node *stable_node;
+	struct hlist_node *hnode, *tmp;
+	int nid = ksm_page_nid(page);
+	bool found = false;
 
 	stable_node = page_stable_node(page);
 	if (stable_node) {			/* ksm page forked */
@@ -994,28 +1089,29 @@ static struct page *stable_tree_search(struct page *page)
 		return page;
 	}
 
-	while (node) {
+	hlist_for_each_entry_safe(stable_node, hnode, tmp,
+			ksm_hash_head(stable_tree_hash, checksum, nid), node) {
 		struct page *tree_page;
-		int ret;
+
+		if (stable_node->checksum != checksum ||
+		    stable_node->nid != nid)
+			continue;
+		found = true;
 
 		cond_resched();
-		stable_node = rb_entry(node, struct stable_node, node);
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
-			return NULL;
-
-		ret = memcmp_pages(page, tree_page);
+			continue;
 
-		if (ret < 0) {
-			put_page(tree_page);
-			node = node->rb_left;
-		} else if (ret > 0) {
-			put_page(tree_page);
-			node = node->rb_right;
-		} else
+		/* It may have been migrated to another node since */
+		if (ksm_page_nid(tree_page) == nid &&
+		    !memcmp_pages(page, tree_page))
 			return tree_page;
+		put_page(tree_page);
 	}
 
+	if (!found)
+		ksm_pass.hash_rejects++;
 	return NULL;
 }
 
@@ -1028,29 +1124,33 @@ static struct page *stable_tree_search(struct page *page)
  */
 static struct stable_node *stable_tree_insert(struct page *kpage)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
-	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
+	struct hlist_node *hnode, *tmp;
+	struct hlist_head *head;
+	int nid = ksm_page_nid(kpage);
+	u32 checksum;
+
+	/* kpage is write-protected now, so its checksum can't change */
+	checksum = calc_checksum(kpage);
+	head = ksm_hash_head(stable_tree_hash, checksum, nid);
 
-	while (*new) {
+	hlist_for_each_entry_safe(stable_node, hnode, tmp, head, node) {
 		struct page *tree_page;
 		int ret;
 
+		if (stable_node->checksum != checksum ||
+		    stable_node->nid != nid)
+			continue;
+
 		cond_resched();
-		stable_node = rb_entry(*new, struct stable_node, node);
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
-			return NULL;
+			continue;
 
 		ret = memcmp_pages(kpage, tree_page);
 		put_page(tree_page);
 
-		parent = *new;
-		if (ret < 0)
-			new = &parent->rb_left;
-		else if (ret > 0)
-			new = &parent->rb_right;
-		else {
+		if (!ret) {
 			/*
 			 * It is not a bug that stable_tree_search() didn't
 			 * find this node: because at that time our page was
@@ -1064,12 +1164,13 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	if (!stable_node)
 		return NULL;
 
-	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, &root_stable_tree);
+	hlist_add_head(&stable_node->node, head);
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->checksum = checksum;
+	stable_node->nid = nid;
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1086,8 +1187,8 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
  * This function returns pointer to rmap_item found to be identical
  * to the currently scanned page, NULL otherwise.
  *
- * This function does both searching and inserting, because they share
- * the same walking algorithm in an rbtree.
+ * rmap_item->oldchecksum must be the current checksum of the page: it
+ * selects the hash chain to search, and is the key it is inserted under.
  */
 static
 struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
@@ -1095,19 +1196,26 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 					      struct page **tree_pagep)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
-	struct rb_node *parent = NULL;
-
-	while (*new) {
-		struct rmap_item *tree_rmap_item;
+	struct rmap_item *tree_rmap_item;
+	struct hlist_node *hnode;
+	struct hlist_head *head;
+	u32 checksum = rmap_item->oldchecksum;
+	int nid = ksm_page_nid(page);
+	bool found = false;
+
+	head = ksm_hash_head(unstable_tree_hash, checksum, nid);
+	hlist_for_each_entry(tree_rmap_item, hnode, head, node) {
 		struct page *tree_page;
-		int ret;
+
+		if (tree_rmap_item->oldchecksum != checksum ||
+		    tree_rmap_item->nid != nid)
+			continue;
+		found = true;
 
 		cond_resched();
-		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
-			return NULL;
+			continue;
 
 		/*
 		 * Don't substitute a ksm page for a forked page.
@@ -1117,25 +1225,20 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 		}
 
-		ret = memcmp_pages(page, tree_page);
-
-		parent = *new;
-		if (ret < 0) {
-			put_page(tree_page);
-			new = &parent->rb_left;
-		} else if (ret > 0) {
-			put_page(tree_page);
-			new = &parent->rb_right;
-		} else {
+		if (!memcmp_pages(page, tree_page)) {
 			*tree_pagep = tree_page;
 			return tree_rmap_item;
 		}
+		put_page(tree_page);
 	}
 
+	if (!found)
+		ksm_pass.hash_rejects++;
+
 	rmap_item->address |= UNSTABLE_FLAG;
 	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
-	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rmap_item->nid = nid;
+	hlist_add_head(&rmap_item->node, head);
 
 	ksm_pages_unshared++;
 	return NULL;
@@ -1178,9 +1281,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
+	ksm_pass.pages_scanned++;
+
+	checksum = calc_checksum(page);
 
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1202,7 +1308,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1272,6 +1377,20 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Account the time ksmd spent on this full scan, and make its statistics
+ * those of the last completed pass.
+ */
+static void ksm_pass_done(void)
+{
+	u64 now = local_clock();
+
+	ksm_pass.scan_ns += now - ksm_scan_clock;
+	ksm_scan_clock = now;
+	ksm_last_pass = ksm_pass;
+	memset(&ksm_pass, 0, sizeof(ksm_pass));
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1296,7 +1415,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 */
 		lru_add_drain_all();
 
-		root_unstable_tree = RB_ROOT;
+		memset(unstable_tree_hash, 0,
+		       sizeof(struct hlist_head) << ksm_hash_shift);
 
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
@@ -1400,6 +1520,7 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
+	ksm_pass_done();
 	return NULL;
 }
 
@@ -1412,15 +1533,17 @@ static void ksm_do_scan(unsigned int scan_npages)
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
+	ksm_scan_clock = local_clock();
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
-			return;
+			break;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
+	ksm_pass.scan_ns += local_clock() - ksm_scan_clock;
 }
 
 static int ksmd_should_run(void)
@@ -1763,15 +1886,17 @@ void ksm_migrate_page(struct page *newpage, struct page *oldpage)
 static struct stable_node *ksm_check_stable_tree(unsigned long start_pfn,
 						 unsigned long end_pfn)
 {
-	struct rb_node *node;
-
-	for (node = rb_first(&root_stable_tree); node; node = rb_next(node)) {
-		struct stable_node *stable_node;
-
-		stable_node = rb_entry(node, struct stable_node, node);
-		if (stable_node->kpfn >= start_pfn &&
-		    stable_node->kpfn < end_pfn)
-			return stable_node;
+	struct stable_node *stable_node;
+	struct hlist_node *hnode;
+	unsigned long i;
+
+	for (i = 0; i < (1UL << ksm_hash_shift); i++) {
+		hlist_for_each_entry(stable_node, hnode,
+				     &stable_tree_hash[i], node) {
+			if (stable_node->kpfn >= start_pfn &&
+			    stable_node->kpfn < end_pfn)
+				return stable_node;
+		}
 	}
 	return NULL;
 }
@@ -1921,6 +2046,74 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 }
 KSM_ATTR(run);
 
+#ifdef CONFIG_NUMA
+static ssize_t merge_across_nodes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_across_nodes);
+}
+
+static ssize_t merge_across_nodes_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err || knob > 1)
+		return -EINVAL;
+
+	/*
+	 * The stable tree is hashed by node when not merging across nodes:
+	 * only switch while there are no ksm pages in it.
+	 */
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_merge_across_nodes != knob) {
+		if (ksm_pages_shared)
+			err = -EBUSY;
+		else
+			ksm_merge_across_nodes = knob;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(merge_across_nodes);
+#endif
+
+static ssize_t checksum_chunks_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_checksum_chunks);
+}
+
+static ssize_t checksum_chunks_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int err;
+	unsigned long chunks;
+
+	err = strict_strtoul(buf, 10, &chunks);
+	if (err || !chunks || chunks > PAGE_SIZE / KSM_CHECKSUM_CHUNK ||
+	    !is_power_of_2(chunks))
+		return -EINVAL;
+
+	/* The stable tree is hashed by checksum: same rule as above */
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_checksum_chunks != chunks) {
+		if (ksm_pages_shared)
+			err = -EBUSY;
+		else
+			ksm_checksum_chunks = chunks;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(checksum_chunks);
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1966,15 +2159,52 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pass_pages_scanned_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_last_pass.pages_scanned);
+}
+KSM_ATTR_RO(pass_pages_scanned);
+
+static ssize_t pass_page_compares_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_last_pass.page_compares);
+}
+KSM_ATTR_RO(pass_page_compares);
+
+static ssize_t pass_hash_rejects_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_last_pass.hash_rejects);
+}
+KSM_ATTR_RO(pass_hash_rejects);
+
+static ssize_t pass_scan_msecs_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       div_u64(ksm_last_pass.scan_ns, NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(pass_scan_msecs);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
 	&run_attr.attr,
+#ifdef CONFIG_NUMA
+	&merge_across_nodes_attr.attr,
+#endif
+	&checksum_chunks_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pass_pages_scanned_attr.attr,
+	&pass_page_compares_attr.attr,
+	&pass_hash_rejects_attr.attr,
+	&pass_scan_msecs_attr.attr,
 	NULL,
 };
 
@@ -1993,6 +2223,10 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
+	err = ksm_hash_init();
+	if (err)
+		goto out_free_slab;
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -2022,6 +2256,8 @@ static int __init ksm_init(void)
 	return 0;
 
 out_free:
+	ksm_hash_free();
+out_free_slab:
 	ksm_slab_free();
 out:
 	return err;
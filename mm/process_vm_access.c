@@ -0,0 +1,421 @@
+/*
+ * linux/mm/process_vm_access.c
+ *
+ * Copy data directly between the address spaces of two processes.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+
+#ifdef CONFIG_COMPAT
+#include <linux/compat.h>
+#endif
+
+/*
+ * Number of struct page pointers we are willing to pin at once.  Requests
+ * spanning fewer pages use an on-stack array, larger ones a kmalloc'ed
+ * array of at most two pages worth of pointers.
+ */
+#define PVM_FAST_PAGES		16
+#define PVM_MAX_KMALLOC_PAGES	(PAGE_SIZE * 2)
+#define PVM_MAX_PP_ARRAY_COUNT	(PVM_MAX_KMALLOC_PAGES / sizeof(struct page *))
+
+/* Position within the local iovec array */
+struct pvm_iter {
+	const struct iovec *iov;
+	unsigned long nr_segs;
+	unsigned long seg;
+	size_t offset;
+};
+
+/**
+ * process_vm_rw_pages - copy between pinned remote pages and local iovecs
+ * @pages: pinned pages of the remote process
+ * @start_offset: offset in the first page to start copying from/to
+ * @len: number of bytes to copy
+ * @lv: local iovec position, advanced by the number of bytes copied
+ * @vm_write: 0 means copy from the remote pages, 1 means copy to them
+ * @bytes_copied: returns number of bytes successfully copied
+ *
+ * Copying stops early, without error, if the local iovecs are exhausted.
+ * Returns 0 on success or -EFAULT if a local buffer could not be accessed.
+ */
+static int process_vm_rw_pages(struct page **pages, unsigned long start_offset,
+			       unsigned long len, struct pvm_iter *lv,
+			       int vm_write, ssize_t *bytes_copied)
+{
+	*bytes_copied = 0;
+
+	while (len && lv->seg < lv->nr_segs) {
+		const struct iovec *iov = &lv->iov[lv->seg];
+		void __user *ubuf = iov->iov_base + lv->offset;
+		unsigned long copy, left;
+		void *kaddr;
+
+		if (lv->offset == iov->iov_len) {
+			lv->seg++;
+			lv->offset = 0;
+			continue;
+		}
+
+		copy = min_t(unsigned long, PAGE_SIZE - start_offset, len);
+		copy = min_t(unsigned long, copy, iov->iov_len - lv->offset);
+
+		kaddr = kmap(*pages) + start_offset;
+		if (vm_write)
+			left = copy_from_user(kaddr, ubuf, copy);
+		else
+			left = copy_to_user(ubuf, kaddr, copy);
+		kunmap(*pages);
+		if (vm_write && left != copy)
+			set_page_dirty_lock(*pages);
+
+		copy -= left;
+		*bytes_copied += copy;
+		if (left)
+			return -EFAULT;
+
+		len -= copy;
+		lv->offset += copy;
+		start_offset += copy;
+		if (start_offset == PAGE_SIZE) {
+			pages++;
+			start_offset = 0;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * process_vm_rw_single_vec - copy one remote iovec to/from the local iovecs
+ * @addr: start address in the remote process
+ * @len: length of the remote region
+ * @lv: local iovec position
+ * @pages: array to pin remote pages into
+ * @pages_max: number of entries in @pages
+ * @mm: mm of the remote process
+ * @task: remote task
+ * @vm_write: 0 means copy from, 1 means copy to the remote process
+ * @bytes_copied: returns number of bytes successfully copied
+ *
+ * Returns 0 on success, error code otherwise.  @bytes_copied is valid in
+ * either case.
+ */
+static int process_vm_rw_single_vec(unsigned long addr, unsigned long len,
+				    struct pvm_iter *lv, struct page **pages,
+				    unsigned long pages_max,
+				    struct mm_struct *mm,
+				    struct task_struct *task,
+				    int vm_write, ssize_t *bytes_copied)
+{
+	unsigned long pa = addr & PAGE_MASK;
+	unsigned long start_offset = addr - pa;
+	unsigned long nr_pages;
+	ssize_t copied;
+	int rc = 0;
+
+	*bytes_copied = 0;
+	if (len == 0)
+		return 0;
+	nr_pages = (addr + len - 1) / PAGE_SIZE - addr / PAGE_SIZE + 1;
+
+	while (nr_pages && lv->seg < lv->nr_segs) {
+		unsigned long batch;
+		int pinned, i;
+
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(task, mm, pa,
+					min(nr_pages, pages_max),
+					vm_write, 0, pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0)
+			return pinned ? pinned : -EFAULT;
+
+		batch = min_t(unsigned long, len,
+			      pinned * PAGE_SIZE - start_offset);
+		rc = process_vm_rw_pages(pages, start_offset, batch, lv,
+					 vm_write, &copied);
+
+		for (i = 0; i < pinned; i++)
+			put_page(pages[i]);
+
+		*bytes_copied += copied;
+		if (rc || copied < batch)
+			break;
+
+		len -= batch;
+		nr_pages -= pinned;
+		pa += pinned * PAGE_SIZE;
+		start_offset = 0;
+	}
+
+	return rc;
+}
+
+/**
+ * process_vm_rw_core - core of reading/writing pages from task specified
+ * @pid: PID of process to read/write from/to
+ * @lvec: iovec array specifying where to copy to/from locally
+ * @liovcnt: size of lvec array
+ * @rvec: iovec array specifying where to copy to/from in the other process
+ * @riovcnt: size of rvec array
+ * @flags: currently unused
+ * @vm_write: 0 if reading from other process, 1 if writing to other process
+ *
+ * Returns the number of bytes read/written or error code.  A partial copy
+ * returns the number of bytes copied up to the first failure.
+ */
+static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
+				  unsigned long liovcnt,
+				  const struct iovec *rvec,
+				  unsigned long riovcnt,
+				  unsigned long flags, int vm_write)
+{
+	struct task_struct *task;
+	struct page *pp_stack[PVM_FAST_PAGES];
+	struct page **process_pages = pp_stack;
+	struct mm_struct *mm;
+	struct pvm_iter lv = {
+		.iov		= lvec,
+		.nr_segs	= liovcnt,
+	};
+	unsigned long i, pages_max = 0;
+	ssize_t bytes_copied = 0;
+	ssize_t copied;
+	ssize_t rc = 0;
+
+	/* Work out how many pages the largest remote iovec spans */
+	for (i = 0; i < riovcnt; i++) {
+		unsigned long start = (unsigned long)rvec[i].iov_base;
+		unsigned long nr_pages;
+
+		if (rvec[i].iov_len == 0)
+			continue;
+		if (start + rvec[i].iov_len < start)
+			return -EFAULT;
+		nr_pages = (start + rvec[i].iov_len - 1) / PAGE_SIZE
+			- start / PAGE_SIZE + 1;
+		pages_max = max(pages_max, nr_pages);
+	}
+
+	if (pages_max == 0)
+		return 0;
+
+	if (pages_max > PVM_FAST_PAGES) {
+		pages_max = min_t(unsigned long, pages_max,
+				  PVM_MAX_PP_ARRAY_COUNT);
+		process_pages = kmalloc(pages_max * sizeof(struct page *),
+					GFP_KERNEL);
+		if (!process_pages)
+			return -ENOMEM;
+	}
+
+	/* Get process information */
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task) {
+		rc = -ESRCH;
+		goto free_proc_pages;
+	}
+
+	/*
+	 * Hold cred_guard_mutex so that the target cannot exec, and so
+	 * change credentials, between the access check and pinning its mm.
+	 */
+	rc = mutex_lock_killable(&task->signal->cred_guard_mutex);
+	if (rc)
+		goto put_task_struct;
+
+	mm = get_task_mm(task);
+	if (!mm) {
+		mutex_unlock(&task->signal->cred_guard_mutex);
+		rc = -EINVAL;
+		goto put_task_struct;
+	}
+	if (!ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		mutex_unlock(&task->signal->cred_guard_mutex);
+		rc = -EPERM;
+		goto put_mm;
+	}
+	mutex_unlock(&task->signal->cred_guard_mutex);
+
+	for (i = 0; i < riovcnt && lv.seg < liovcnt; i++) {
+		rc = process_vm_rw_single_vec(
+			(unsigned long)rvec[i].iov_base, rvec[i].iov_len,
+			&lv, process_pages, pages_max, mm, task, vm_write,
+			&copied);
+		bytes_copied += copied;
+		if (rc < 0 || copied < rvec[i].iov_len)
+			break;
+	}
+
+	/* Report partial success, the error only if nothing was copied */
+	if (bytes_copied)
+		rc = bytes_copied;
+
+put_mm:
+	mmput(mm);
+
+put_task_struct:
+	put_task_struct(task);
+
+free_proc_pages:
+	if (process_pages != pp_stack)
+		kfree(process_pages);
+	return rc;
+}
+
+/**
+ * process_vm_rw - check iovecs before calling core routine
+ * @pid: PID of process to read/write from/to
+ * @lvec: iovec array specifying where to copy to/from locally
+ * @liovcnt: size of lvec array
+ * @rvec: iovec array specifying where to copy to/from in the other process
+ * @riovcnt: size of rvec array
+ * @flags: currently unused
+ * @vm_write: 0 if reading from other process, 1 if writing to other process
+ *
+ * Returns the number of bytes read/written or error code.
+ */
+static ssize_t process_vm_rw(pid_t pid,
+			     const struct iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	/* Check iovecs */
+	rc = rw_copy_check_uvector(vm_write ? WRITE : READ, lvec, liovcnt,
+				   UIO_FASTIOV, iovstack_l, &iov_l);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	/* The remote iovec is only checked for sanity, not accessibility */
+	rc = rw_copy_check_uvector(CHECK_IOVEC_ONLY, rvec, riovcnt,
+				   UIO_FASTIOV, iovstack_r, &iov_r);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+
+	return rc;
+}
+
+SYSCALL_DEFINE6(process_vm_readv, pid_t, pid, const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 0);
+}
+
+SYSCALL_DEFINE6(process_vm_writev, pid_t, pid,
+		const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 1);
+}
+
+#ifdef CONFIG_COMPAT
+
+static ssize_t
+compat_process_vm_rw(compat_pid_t pid,
+		     const struct compat_iovec __user *lvec,
+		     unsigned long liovcnt,
+		     const struct compat_iovec __user *rvec,
+		     unsigned long riovcnt,
+		     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc = -EFAULT;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_READ, lvec, liovcnt * sizeof(*lvec)))
+		goto out;
+
+	if (!access_ok(VERIFY_READ, rvec, riovcnt * sizeof(*rvec)))
+		goto out;
+
+	rc = compat_rw_copy_check_uvector(vm_write ? WRITE : READ, lvec,
+					  liovcnt, UIO_FASTIOV, iovstack_l,
+					  &iov_l);
+	if (rc <= 0)
+		goto free_iovecs;
+	rc = compat_rw_copy_check_uvector(CHECK_IOVEC_ONLY, rvec, riovcnt,
+					  UIO_FASTIOV, iovstack_r, &iov_r);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+
+out:
+	return rc;
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_readv(compat_pid_t pid,
+			    const struct compat_iovec __user *lvec,
+			    unsigned long liovcnt,
+			    const struct compat_iovec __user *rvec,
+			    unsigned long riovcnt,
+			    unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 0);
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_writev(compat_pid_t pid,
+			     const struct compat_iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct compat_iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 1);
+}
+
+#endif
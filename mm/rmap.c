@@ -653,10 +653,9 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 {
 	struct mm_struct *mm = vma->vm_mm;
 	int referenced = 0;
+	pmd_t *pmd;
 
 	if (unlikely(PageTransHuge(page))) {
-		pmd_t *pmd;
-
 		spin_lock(&mm->page_table_lock);
 		/*
 		 * rmap might return false positives; we must filter
@@ -680,6 +679,23 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		if (pmdp_clear_flush_young_notify(vma, address, pmd))
 			referenced++;
 		spin_unlock(&mm->page_table_lock);
+	} else if (unlikely(pmd = page_check_address_pagecache_pmd(page,
+							vma, address))) {
+		/*
+		 * The young bit is shared by all the pages under the
+		 * pmd: they age together until the pmd is split.
+		 */
+		if (vma->vm_flags & VM_LOCKED) {
+			spin_unlock(&mm->page_table_lock);
+			*mapcount = 0;	/* break early from loop */
+			*vm_flags |= VM_LOCKED;
+			goto out;
+		}
+
+		if (pmdp_clear_flush_young_notify(vma,
+				address & HPAGE_PMD_MASK, pmd))
+			referenced++;
+		spin_unlock(&mm->page_table_lock);
 	} else {
 		pte_t *pte;
 		spinlock_t *ptl;
@@ -1175,6 +1191,13 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = SWAP_AGAIN;
 
+	/*
+	 * Pagecache mapped by a huge pmd has no pte to unmap until the
+	 * pmd is split.
+	 */
+	if (!PageAnon(page) && vma_huge_pagecache(vma))
+		split_huge_page_address(vma, address);
+
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
@@ -63,6 +63,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/khugepaged.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -91,6 +92,21 @@ enum sgp_type {
 	SGP_WRITE,	/* may exceed i_size, may allocate page */
 };
 
+/*
+ * Definitions for the "huge" tmpfs mount option and for the
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled knob, which also
+ * applies to the internal mount behind SysV shm and shared anonymous
+ * mappings.
+ */
+#define SHMEM_HUGE_NEVER	0	/* never try for hugepages */
+#define SHMEM_HUGE_ALWAYS	1	/* always try for hugepages */
+#define SHMEM_HUGE_WITHIN_SIZE	2	/* only if the block fits in i_size */
+#define SHMEM_HUGE_ADVISE	3	/* only for madvise(MADV_HUGEPAGE) */
+
+/* Only for shmem_enabled: testing overrides, on all mounts at once */
+#define SHMEM_HUGE_DENY		(-1)	/* disable hugepages everywhere */
+#define SHMEM_HUGE_FORCE	(-2)	/* enable hugepages everywhere */
+
 #ifdef CONFIG_TMPFS
 static unsigned long shmem_default_max_blocks(void)
 {
@@ -142,10 +158,11 @@ static inline void shmem_unacct_size(unsigned long flags, loff_t size)
  * shmem_getpage reports shmem_acct_block failure as -ENOSPC not -ENOMEM,
  * so that a failure on a sparse tmpfs mapping will give SIGBUS not OOM.
  */
-static inline int shmem_acct_block(unsigned long flags)
+static inline int shmem_acct_block(unsigned long flags, long pages)
 {
 	return (flags & VM_NORESERVE) ?
-		security_vm_enough_memory_kern(VM_ACCT(PAGE_CACHE_SIZE)) : 0;
+		security_vm_enough_memory_kern(pages *
+					VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
@@ -823,6 +840,601 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int shmem_huge __read_mostly;
+
+#if defined(CONFIG_SYSFS) || defined(CONFIG_TMPFS)
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+#endif
+
+#ifdef CONFIG_SYSFS
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count;
+
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = shmem_huge == values[i] ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				 shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+	if (!has_transparent_hugepage() &&
+	    huge != SHMEM_HUGE_NEVER && huge != SHMEM_HUGE_DENY)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	if (shmem_huge > SHMEM_HUGE_DENY)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_SYSFS */
+
+/*
+ * Whether a block of hugepage size around @index of @inode may be
+ * allocated in one go, for a fault in @vma or for a read or write.
+ */
+static bool shmem_huge_allowed(struct inode *inode, pgoff_t index,
+			       struct vm_area_struct *vma)
+{
+	pgoff_t size;
+
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+	if (vma && (vma->vm_flags & VM_NOHUGEPAGE))
+		return false;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		size = round_up(i_size_read(inode), PAGE_CACHE_SIZE) >>
+							PAGE_CACHE_SHIFT;
+		if (round_up(index + 1, HPAGE_PMD_NR) <= size)
+			return true;
+		/* fall through */
+	case SHMEM_HUGE_ADVISE:
+		return vma && (vma->vm_flags & VM_HUGEPAGE);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Whether @vma may map shmem with huge pmds: a shared linear mapping
+ * with file offsets aligned like the virtual addresses.
+ */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct file *file = vma->vm_file;
+
+	if (!file || file->f_mapping->backing_dev_info !=
+					&shmem_backing_dev_info)
+		return false;
+	if ((vma->vm_flags & (VM_SHARED | VM_NONLINEAR)) != VM_SHARED)
+		return false;
+	if (((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff) &
+						(HPAGE_PMD_NR - 1))
+		return false;
+	return shmem_huge_allowed(file->f_mapping->host, vma->vm_pgoff, vma);
+}
+
+/*
+ * The block is allocated as one huge page but split_page()d right
+ * away: each of its pages then lives in the pagecache as any other,
+ * and only the huge pmd mapping them knows they are contiguous.
+ */
+#ifdef CONFIG_NUMA
+static struct page *shmem_alloc_hugeblock(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = index;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	/*
+	 * alloc_pages_vma() will drop the shared policy reference
+	 */
+	return alloc_pages_vma(gfp | __GFP_NORETRY | __GFP_NOWARN |
+			       __GFP_NOMEMALLOC | __GFP_NO_KSWAPD,
+			       HPAGE_PMD_ORDER, &pvma, 0, numa_node_id());
+}
+#else
+static inline struct page *shmem_alloc_hugeblock(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return alloc_pages(gfp | __GFP_NORETRY | __GFP_NOWARN |
+			   __GFP_NOMEMALLOC | __GFP_NO_KSWAPD,
+			   HPAGE_PMD_ORDER);
+}
+#endif
+
+/*
+ * Fill the aligned range around @index, if it is a hole, with a block
+ * of pages from one huge allocation. Returns 0 when all of them went
+ * in; otherwise the caller falls back to a single page, and the pages
+ * which made it into the cache before a racing insertion stay there.
+ */
+static int shmem_add_hugeblock(struct inode *inode, pgoff_t index, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t hindex = index & ~(pgoff_t)(HPAGE_PMD_NR - 1);
+	unsigned long found;
+	struct page *page;
+	void **slot;
+	int error, i, nr;
+
+	rcu_read_lock();
+	nr = radix_tree_gang_lookup_slot(&mapping->page_tree, &slot,
+					 &found, hindex, 1);
+	rcu_read_unlock();
+	if (nr && found < hindex + HPAGE_PMD_NR)
+		return -EEXIST;
+
+	if (shmem_acct_block(info->flags, HPAGE_PMD_NR))
+		return -ENOSPC;
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR) > 0) {
+			error = -ENOSPC;
+			goto unacct;
+		}
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+	}
+
+	page = shmem_alloc_hugeblock(gfp, info, hindex);
+	if (!page) {
+		error = -ENOMEM;
+		goto decused;
+	}
+	split_page(page, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		clear_highpage(page + i);
+		flush_dcache_page(page + i);
+		SetPageUptodate(page + i);
+		SetPageSwapBacked(page + i);
+		__set_page_locked(page + i);
+		error = mem_cgroup_cache_charge(page + i, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (!error)
+			error = shmem_add_to_page_cache(page + i, mapping,
+						hindex + i, gfp, NULL);
+		if (error) {
+			__clear_page_locked(page + i);
+			break;
+		}
+		lru_cache_add_anon(page + i);
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	nr = i;
+	for (; i < HPAGE_PMD_NR; i++)
+		page_cache_release(page + i);
+
+	spin_lock(&info->lock);
+	info->alloced += nr;
+	inode->i_blocks += BLOCKS_PER_PAGE * nr;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	if (nr == HPAGE_PMD_NR) {
+		count_vm_event(THP_FILE_ALLOC);
+		return 0;
+	}
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, nr - HPAGE_PMD_NR);
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR - nr);
+	return error;
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -HPAGE_PMD_NR);
+unacct:
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+	return error;
+}
+
+/*
+ * Look up the pages at the aligned @hindex, and return the first with
+ * a reference held on each if they are the pages of one block.
+ */
+static struct page *shmem_find_hugeblock(struct address_space *mapping,
+					 pgoff_t hindex)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	struct page *head = NULL;
+	pgoff_t index = hindex;
+	unsigned int i, nr;
+
+	do {
+		nr = find_get_pages_contig(mapping, index,
+				min_t(pgoff_t, PAGEVEC_SIZE,
+				      hindex + HPAGE_PMD_NR - index), pages);
+		for (i = 0; i < nr; i++, index++) {
+			if (index == hindex) {
+				if (page_to_pfn(pages[i]) & (HPAGE_PMD_NR - 1))
+					break;
+				head = pages[i];
+			} else if (pages[i] != head + (index - hindex))
+				break;
+		}
+		if (i < nr) {
+			while (i < nr)
+				page_cache_release(pages[i++]);
+			break;
+		}
+	} while (nr && index < hindex + HPAGE_PMD_NR);
+
+	if (index == hindex + HPAGE_PMD_NR)
+		return head;
+	while (index > hindex)
+		page_cache_release(head + (--index - hindex));
+	return NULL;
+}
+
+/**
+ * shmem_collapse_hugeblock - gather a range of shmem into one block
+ * @mapping: the shmem mapping
+ * @index: first index of the range, aligned to HPAGE_PMD_NR
+ * @max_none: how many holes in the range may be filled
+ *
+ * For khugepaged: copy the pages of the range into the pages of one
+ * huge allocation, and replace them in the pagecache, so that the next
+ * fault can map the range with a huge pmd. The old pages are unmapped,
+ * and holes are filled from the new block, only once the collapse is
+ * certain to go ahead; it gives up on anything it cannot take over:
+ * pages on swap, pinned or mlocked pages, or a racing truncation.
+ *
+ * Returns 1 if the range was collapsed, 0 if it already was a block,
+ * or a negative error.
+ */
+int shmem_collapse_hugeblock(struct address_space *mapping, pgoff_t index,
+			     int max_none)
+{
+	struct inode *inode = mapping->host;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	gfp_t gfp = mapping_gfp_mask(mapping);
+	struct page **old, *new, *page;
+	int i, nr_none = 0, locked = 0, charged = 0, filled = 0;
+	int error;
+
+	VM_BUG_ON(index & (HPAGE_PMD_NR - 1));
+
+	page = shmem_find_hugeblock(mapping, index);
+	if (page) {
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			page_cache_release(page + i);
+		return 0;
+	}
+
+	/* Truncation and hole punching hold i_mutex: keep them out */
+	if (!mutex_trylock(&inode->i_mutex))
+		return -EAGAIN;
+	error = -EINVAL;
+	if ((loff_t)(index + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT >
+						i_size_read(inode))
+		goto out_unlock_inode;
+
+	error = -ENOMEM;
+	old = kcalloc(HPAGE_PMD_NR, sizeof(*old), GFP_KERNEL);
+	if (!old)
+		goto out_unlock_inode;
+
+	error = -EBUSY;
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (radix_tree_exceptional_entry(page))
+			goto out_put;
+		if (!page && ++nr_none > max_none)
+			goto out_put;
+		old[i] = page;
+	}
+
+	error = -ENOMEM;
+	new = shmem_alloc_hugeblock(gfp, info, index);
+	if (!new) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		goto out_put;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	split_page(new, HPAGE_PMD_ORDER);
+
+	/* Faults and shmem_getpage need the page lock to use a page */
+	error = -EBUSY;
+	for (; locked < HPAGE_PMD_NR; locked++) {
+		page = old[locked];
+		if (!page)
+			continue;
+		lock_page(page);
+		if (page->mapping != mapping ||
+		    page->index != index + locked ||
+		    !PageUptodate(page) || PageMlocked(page)) {
+			locked++;
+			goto out_unlock;
+		}
+	}
+
+	/*
+	 * The pagecache, us and the ptes: anything else and the page is in
+	 * use, so give up before unmapping anything.
+	 */
+	lru_add_drain();
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (old[i] && page_count(old[i]) != 2 + page_mapcount(old[i]))
+			goto out_unlock;
+
+	unmap_mapping_range(mapping, (loff_t)index << PAGE_CACHE_SHIFT,
+			    HPAGE_PMD_SIZE, 0);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (old[i] && (page_mapped(old[i]) || page_count(old[i]) != 2))
+			goto out_unlock;
+
+	for (; charged < HPAGE_PMD_NR; charged++) {
+		struct page *src = old[charged];
+
+		page = new + charged;
+		if (src) {
+			copy_highpage(page, src);
+			if (PageDirty(src))
+				SetPageDirty(page);
+		} else
+			clear_highpage(page);
+		flush_dcache_page(page);
+		SetPageUptodate(page);
+		SetPageSwapBacked(page);
+		__set_page_locked(page);
+		/* holes are charged when they are added to the pagecache */
+		if (src && mem_cgroup_cache_charge(page, current->mm,
+						   GFP_KERNEL))
+			goto out_unlock;
+	}
+
+	/*
+	 * Only now that the collapse is going ahead, fill the holes with
+	 * pages of the new block, accounting them as shmem_getpage would.
+	 */
+	if (nr_none) {
+		error = -ENOSPC;
+		if (shmem_acct_block(info->flags, nr_none))
+			goto out_unlock;
+		if (sbinfo->max_blocks) {
+			if (sbinfo->max_blocks < nr_none ||
+			    percpu_counter_compare(&sbinfo->used_blocks,
+					sbinfo->max_blocks - nr_none) > 0)
+				goto out_unacct;
+			percpu_counter_add(&sbinfo->used_blocks, nr_none);
+		}
+	}
+
+	for (; filled < HPAGE_PMD_NR; filled++) {
+		if (old[filled])
+			continue;
+		page = new + filled;
+		error = mem_cgroup_cache_charge(page, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (!error)
+			error = shmem_add_to_page_cache(page, mapping,
+						index + filled, gfp, NULL);
+		if (error)
+			goto out_unfill;
+	}
+
+	error = -EBUSY;
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (old[i] && !page_freeze_refs(old[i], 2)) {
+			while (i--)
+				if (old[i])
+					page_unfreeze_refs(old[i], 2);
+			spin_unlock_irq(&mapping->tree_lock);
+			goto out_unfill;
+		}
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (!old[i])
+			continue;
+		page = new + i;
+		page_cache_get(page);
+		page->mapping = mapping;
+		page->index = index + i;
+		error = shmem_radix_tree_replace(mapping, index + i,
+						 old[i], page);
+		VM_BUG_ON(error);
+		__dec_zone_page_state(old[i], NR_FILE_PAGES);
+		__dec_zone_page_state(old[i], NR_SHMEM);
+		__inc_zone_page_state(page, NR_FILE_PAGES);
+		__inc_zone_page_state(page, NR_SHMEM);
+		old[i]->mapping = NULL;
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+
+	if (nr_none) {
+		spin_lock(&info->lock);
+		info->alloced += nr_none;
+		inode->i_blocks += BLOCKS_PER_PAGE * nr_none;
+		shmem_recalc_inode(inode);
+		spin_unlock(&info->lock);
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (old[i]) {
+			page_unfreeze_refs(old[i], 1);
+			mem_cgroup_uncharge_cache_page(old[i]);
+			unlock_page(old[i]);
+			page_cache_release(old[i]);
+		}
+
+		lru_cache_add_anon(new + i);
+		unlock_page(new + i);
+		page_cache_release(new + i);
+	}
+	kfree(old);
+	mutex_unlock(&inode->i_mutex);
+	return 1;
+
+out_unfill:
+	/* shmem_getpage may be waiting on them: they need a real unlock */
+	while (filled--) {
+		if (old[filled])
+			continue;
+		page = new + filled;
+		shmem_delete_from_page_cache(page, NULL);
+		mem_cgroup_uncharge_cache_page(page);
+		unlock_page(page);
+	}
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -nr_none);
+out_unacct:
+	shmem_unacct_blocks(info->flags, nr_none);
+out_unlock:
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (i < charged && old[i])
+			mem_cgroup_uncharge_cache_page(new + i);
+		if (PageLocked(new + i))
+			__clear_page_locked(new + i);
+		page_cache_release(new + i);
+	}
+	while (locked--)
+		if (old[locked])
+			unlock_page(old[locked]);
+out_put:
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (old[i] && !radix_tree_exceptional_entry(old[i]))
+			page_cache_release(old[i]);
+	kfree(old);
+out_unlock_inode:
+	mutex_unlock(&inode->i_mutex);
+	return error;
+}
+
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_mapping->host;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	pgoff_t hindex;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	if (!shmem_huge_enabled(vma))
+		return VM_FAULT_FALLBACK;
+	if (unlikely(!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags)) &&
+	    __khugepaged_enter(vma->vm_mm))
+		return VM_FAULT_OOM;
+
+	/* shmem_huge_enabled() checked that hindex is aligned */
+	hindex = ((haddr - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	if ((loff_t)(hindex + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT >
+						i_size_read(inode))
+		return VM_FAULT_FALLBACK;
+
+	page = shmem_find_hugeblock(inode->i_mapping, hindex);
+	if (!page) {
+		if (shmem_add_hugeblock(inode, hindex,
+				mapping_gfp_mask(inode->i_mapping)))
+			return VM_FAULT_FALLBACK;
+		page = shmem_find_hugeblock(inode->i_mapping, hindex);
+		if (!page)
+			return VM_FAULT_FALLBACK;
+	}
+	return do_huge_pmd_file_page(vma->vm_mm, vma, address, pmd,
+				     page, flags);
+}
+#else /* !CONFIG_TRANSPARENT_HUGEPAGE */
+static inline bool shmem_huge_allowed(struct inode *inode, pgoff_t index,
+				      struct vm_area_struct *vma)
+{
+	return false;
+}
+
+static inline int shmem_add_hugeblock(struct inode *inode, pgoff_t index,
+				      gfp_t gfp)
+{
+	return -EINVAL;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -840,6 +1452,7 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 	swp_entry_t swap;
 	int error;
 	int once = 0;
+	bool tried_huge = false;
 
 	if (index > (MAX_LFS_FILESIZE >> PAGE_CACHE_SHIFT))
 		return -EFBIG;
@@ -877,7 +1490,7 @@ repeat:
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
-		page = lookup_swap_cache(swap);
+		page = lookup_swap_cache(swap, NULL, 0);
 		if (!page) {
 			/* here we actually do the io */
 			if (fault_type)
@@ -924,7 +1537,12 @@ repeat:
 		swap_free(swap);
 
 	} else {
-		if (shmem_acct_block(info->flags)) {
+		if (!tried_huge && shmem_huge_allowed(inode, index, NULL)) {
+			tried_huge = true;
+			if (!shmem_add_hugeblock(inode, index, gfp))
+				goto repeat;
+		}
+		if (shmem_acct_block(info->flags, 1)) {
 			error = -ENOSPC;
 			goto failed;
 		}
@@ -1077,6 +1695,104 @@ out_nomem:
 	return retval;
 }
 
+unsigned long shmem_get_unmapped_area(struct file *file,
+				      unsigned long uaddr, unsigned long len,
+				      unsigned long pgoff, unsigned long flags)
+{
+	unsigned long (*get_area)(struct file *,
+		unsigned long, unsigned long, unsigned long, unsigned long);
+	unsigned long addr;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	unsigned long offset;
+	unsigned long inflated_len;
+	unsigned long inflated_addr;
+	unsigned long inflated_offset;
+#endif
+
+	if (len > TASK_SIZE)
+		return -ENOMEM;
+
+	get_area = current->mm->get_unmapped_area;
+	addr = get_area(file, uaddr, len, pgoff, flags);
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (IS_ERR_VALUE(addr))
+		return addr;
+	if (addr & ~PAGE_MASK)
+		return addr;
+	if (addr > TASK_SIZE - len)
+		return addr;
+
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return addr;
+	if (len < HPAGE_PMD_SIZE)
+		return addr;
+	if (flags & MAP_FIXED)
+		return addr;
+	/*
+	 * Only MAP_SHARED is mapped hugely (see shmem_huge_enabled()),
+	 * so there is no point in aligning a MAP_PRIVATE mapping.
+	 * And if caller specified an address hint, respect that as before.
+	 */
+	if (!(flags & MAP_SHARED))
+		return addr;
+	if (uaddr)
+		return addr;
+
+	if (shmem_huge != SHMEM_HUGE_FORCE) {
+		struct super_block *sb;
+
+		if (file) {
+			sb = file->f_path.dentry->d_inode->i_sb;
+		} else {
+			/*
+			 * Called directly from mm/mmap.c, or drivers/char/mem.c
+			 * for "/dev/zero", to create a shared anonymous object.
+			 */
+			if (IS_ERR(shm_mnt))
+				return addr;
+			sb = shm_mnt->mnt_sb;
+		}
+		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+			return addr;
+	}
+
+	offset = (pgoff << PAGE_SHIFT) & (HPAGE_PMD_SIZE - 1);
+	if (offset && offset + len < 2 * HPAGE_PMD_SIZE)
+		return addr;
+	if ((addr & (HPAGE_PMD_SIZE - 1)) == offset)
+		return addr;
+
+	/*
+	 * Ask for more than we need, and keep the part of it at which
+	 * the virtual address and the file offset line up on hugepage
+	 * boundaries.
+	 */
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len > TASK_SIZE)
+		return addr;
+	if (inflated_len < len)
+		return addr;
+
+	inflated_addr = get_area(NULL, 0, inflated_len, 0, flags);
+	if (IS_ERR_VALUE(inflated_addr))
+		return addr;
+	if (inflated_addr & ~PAGE_MASK)
+		return addr;
+
+	inflated_offset = inflated_addr & (HPAGE_PMD_SIZE - 1);
+	inflated_addr += offset - inflated_offset;
+	if (inflated_offset > offset)
+		inflated_addr += HPAGE_PMD_SIZE;
+
+	if (inflated_addr > TASK_SIZE - len)
+		return addr;
+	return inflated_addr;
+#else
+	return addr;
+#endif
+}
+
 static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	file_accessed(file);
@@ -2059,6 +2775,17 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char,"huge")) {
+			int huge;
+			huge = shmem_parse_huge(value);
+			if (huge < 0)
+				goto bad_val;
+			if (!has_transparent_hugepage() &&
+			    huge != SHMEM_HUGE_NEVER)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2104,6 +2831,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2127,6 +2855,11 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* Rightly or wrongly, show huge mount option unmasked by shmem_huge */
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2271,6 +3004,7 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+	.get_unmapped_area = shmem_get_unmapped_area,
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2344,6 +3078,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2446,6 +3183,15 @@ void shmem_truncate_range(struct inode *inode, loff_t lstart, loff_t lend)
 }
 EXPORT_SYMBOL_GPL(shmem_truncate_range);
 
+#ifdef CONFIG_MMU
+unsigned long shmem_get_unmapped_area(struct file *file,
+				      unsigned long addr, unsigned long len,
+				      unsigned long pgoff, unsigned long flags)
+{
+	return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+#endif
+
 #define shmem_vm_ops				generic_file_vm_ops
 #define shmem_file_operations			ramfs_file_operations
 #define shmem_get_inode(sb, dir, mode, dev, flags)	ramfs_get_inode(sb, dir, mode, dev)
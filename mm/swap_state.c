@@ -60,7 +60,7 @@ void show_swap_cache_info(void)
 	printk("Swap cache stats: add %lu, delete %lu, find %lu/%lu\n",
 		swap_cache_info.add_total, swap_cache_info.del_total,
 		swap_cache_info.find_success, swap_cache_info.find_total);
-	printk("Free swap  = %ldkB\n", nr_swap_pages << (PAGE_SHIFT - 10));
+	printk("Free swap  = %ldkB\n", get_nr_swap_pages() << (PAGE_SHIFT - 10));
 	printk("Total swap = %lukB\n", total_swap_pages << (PAGE_SHIFT - 10));
 }
 
@@ -254,37 +254,79 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * vma->swap_readahead_info packs the page aligned address of the last
+ * swap fault in the vma, the readahead window used for it, and the
+ * number of readahead pages from the vma that were faulted in since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Upper bound of the vma readahead window is 1 << SWAP_RA_ORDER_CEILING */
+#if BITS_PER_LONG == 64
+#define SWAP_RA_ORDER_CEILING	5
+#else
+#define SWAP_RA_ORDER_CEILING	3
+#endif
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * If the page was brought in by swap readahead, account the hit against
+ * @vma, so that swap_vma_readahead() widens its window.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma) {
+				unsigned long ra_val, hits;
+
+				ra_val = atomic_long_read(&vma->swap_readahead_info);
+				hits = SWAP_RA_HITS(ra_val);
+				if (hits < SWAP_RA_HITS_MAX)
+					hits++;
+				atomic_long_set(&vma->swap_readahead_info,
+						SWAP_RA_VAL(SWAP_RA_ADDR(ra_val),
+							    SWAP_RA_WIN(ra_val),
+							    hits));
+			}
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
- * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
- */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -335,6 +377,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -352,6 +395,45 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_allocated;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_allocated);
+}
+
+/*
+ * Start async read of a swap entry.  Unless it is the one being faulted,
+ * mark a newly read page so that a later lookup_swap_cache() can tell it
+ * was a readahead hit.  Returns false if the read could not be started.
+ */
+static bool swap_readahead_page(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool readahead)
+{
+	struct page *page;
+	bool page_allocated;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_allocated);
+	if (!page)
+		return false;
+	if (page_allocated && readahead) {
+		SetPageReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return true;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -375,7 +457,6 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	int nr_pages;
-	struct page *page;
 	unsigned long offset;
 	unsigned long end_offset;
 
@@ -389,12 +470,136 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (!swap_readahead_page(swp_entry(swp_type(entry), offset),
+					 gfp_mask, vma, addr,
+					 offset != swp_offset(entry)))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the vma readahead window: start with two pages when the fault
+ * is next to the previous one, otherwise read nothing extra until there
+ * have been readahead hits, then round hits up to a power of two.
+ * The window never shrinks by more than half at a time.
+ */
+static unsigned int swap_ra_nr_pages(unsigned long prev_pfn,
+				     unsigned long pfn, unsigned long hits,
+				     unsigned int max_pages,
+				     unsigned int prev_win)
+{
+	unsigned int pages, roundup, last_ra;
+
+	pages = hits + 2;
+	if (pages == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			pages = 1;
+	} else {
+		roundup = 4;
+		while (roundup < pages)
+			roundup <<= 1;
+		pages = roundup;
+	}
+
+	if (pages > max_pages)
+		pages = max_pages;
+
+	last_ra = prev_win / 2;
+	if (pages < last_ra)
+		pages = last_ra;
+
+	return pages;
+}
+
+/**
+ * swap_vma_readahead - swap in pages around a fault in hope we need them soon
+ * @fentry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the fault is in
+ * @addr: faulting address
+ *
+ * Returns the struct page for @fentry, after queueing swapin.
+ *
+ * Instead of reading around @fentry in the swap area, read the swap
+ * entries of the ptes around @addr: once swap is fragmented, the slots
+ * next to the faulting one usually belong to somebody else, while the
+ * neighbouring ptes are likely to be faulted in soon. The window is
+ * bounded by page_cluster, by the vma and by the page table, and it
+ * adapts to how many earlier readahead pages were actually used.
+ *
+ * Seeking is expensive on rotating swap devices, so as long as one is in
+ * use, fall back to swapin_readahead().
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+				struct vm_area_struct *vma, unsigned long addr)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, faddr, fpfn, pfn, lower, upper, start, end;
+	unsigned int max_win, prev_win, win, left, i;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	if (atomic_read(&nr_rotate_swap))
+		return swapin_readahead(fentry, gfp_mask, vma, addr);
+
+	max_win = 1 << min_t(unsigned int, ACCESS_ONCE(page_cluster),
+			     SWAP_RA_ORDER_CEILING);
+	faddr = addr & PAGE_MASK;
+	fpfn = PFN_DOWN(faddr);
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	prev_win = SWAP_RA_WIN(ra_val);
+	win = swap_ra_nr_pages(pfn, fpfn, SWAP_RA_HITS(ra_val),
+			       max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(faddr, win, 0));
+
+	if (win == 1)
+		goto skip;
+
+	/* Read forward or backward along a sequential fault pattern */
+	if (fpfn == pfn + 1)
+		left = 0;
+	else if (pfn == fpfn + 1)
+		left = win - 1;
+	else
+		left = (win - 1) / 2;
+
+	/* Stay within the vma and the page table of the fault */
+	lower = max(PFN_DOWN(vma->vm_start), PFN_DOWN(faddr & PMD_MASK));
+	upper = min(PFN_DOWN(vma->vm_end),
+		    PFN_DOWN(faddr & PMD_MASK) + PTRS_PER_PTE);
+	start = fpfn - min_t(unsigned long, left, fpfn - lower);
+	end = min(start + win, upper);
+
+	pgd = pgd_offset(vma->vm_mm, faddr);
+	pud = pud_offset(pgd, faddr);
+	pmd = pmd_offset(pud, faddr);
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < end - start; i++) {
+		swp_entry_t entry;
+
+		if (!is_swap_pte(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		if (!swap_readahead_page(entry, gfp_mask, vma,
+					 (start + i) << PAGE_SHIFT,
+					 start + i != fpfn))
+			break;
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, addr);
+}
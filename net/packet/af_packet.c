@@ -161,13 +161,41 @@ struct packet_mreq_max {
 	unsigned char	mr_address[MAX_ADDR_LEN];
 };
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		int closing, int tx_ring);
 
 struct pgv {
 	char *buffer;
 };
 
+/* Kernel side state of a TPACKET_V3 block-based rx ring. */
+struct tpacket_kbdq_core {
+	struct pgv	*pkbdq;
+	unsigned int	feature_req_word;
+	unsigned int	knum_blocks;
+	unsigned int	kblk_size;
+	unsigned int	blk_sizeof_priv;
+
+	/* block currently being filled */
+	unsigned int	kactive_blk_num;
+
+	/* all blocks are owned by user space, incoming packets are dropped */
+	unsigned int	blk_frozen:1;
+	unsigned int	delete_blk_timer:1;
+
+	char		*nxt_offset;
+	char		*blk_end;
+	struct tpacket3_hdr	*prev;
+	u64		knxt_seq_num;
+
+	/* packets being copied into the active block outside the lock */
+	atomic_t	blk_fill_in_prog;
+
+	unsigned int	retire_blk_tov;
+	unsigned long	tov_in_jiffies;
+	struct timer_list	retire_blk_timer;
+};
+
 struct packet_ring_buffer {
 	struct pgv		*pg_vec;
 	unsigned int		head;
@@ -179,6 +207,7 @@ struct packet_ring_buffer {
 	unsigned int		pg_vec_pages;
 	unsigned int		pg_vec_len;
 
+	struct tpacket_kbdq_core	prb_bdqc;
 	atomic_t		pending;
 };
 
@@ -192,7 +221,7 @@ struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
 	struct packet_fanout	*fanout;
-	struct tpacket_stats	stats;
+	struct tpacket_stats_v3	stats;
 	struct packet_ring_buffer	rx_ring;
 	struct packet_ring_buffer	tx_ring;
 	int			copy_thresh;
@@ -402,6 +431,256 @@ static inline void packet_increment_head(struct packet_ring_buffer *buff)
 	buff->head = buff->head != buff->frame_max ? buff->head+1 : 0;
 }
 
+/*
+ * TPACKET_V3 rx ring.
+ *
+ * Rather than one fixed size frame per packet, packets are packed back to
+ * back into the active block, and user space is handed whole blocks.  A
+ * block is closed when the next packet does not fit into it any more, or
+ * by the retire timer when traffic is slow, so that a busy socket sees one
+ * status change and one wakeup per block instead of per packet.
+ *
+ * All state below is protected by sk_receive_queue.lock, except for the
+ * packet copy itself which tpacket_rcv() does after dropping the lock.
+ * blk_fill_in_prog counts those copies, and a block is not handed to user
+ * space before they have finished.
+ */
+#define BLK_HDR_LEN	TPACKET_ALIGN(sizeof(struct tpacket_block_desc))
+#define BLK_PLUS_PRIV(sz_of_priv) \
+	(BLK_HDR_LEN + TPACKET_ALIGN(sz_of_priv))
+
+#define DEFAULT_PRB_RETIRE_TOV	8	/* msecs */
+
+static inline struct tpacket_block_desc *
+prb_block(struct tpacket_kbdq_core *pkc, unsigned int blk_num)
+{
+	return (struct tpacket_block_desc *)pkc->pkbdq[blk_num].buffer;
+}
+
+static inline unsigned int prb_next_blk_num(struct tpacket_kbdq_core *pkc,
+					    unsigned int blk_num)
+{
+	return blk_num < pkc->knum_blocks - 1 ? blk_num + 1 : 0;
+}
+
+static int prb_block_status(struct tpacket_block_desc *pbd)
+{
+	smp_rmb();
+	flush_dcache_page(pgv_to_page(&pbd->hdr.bh1.block_status));
+	return pbd->hdr.bh1.block_status;
+}
+
+static void prb_set_retire_timer(struct tpacket_kbdq_core *pkc)
+{
+	mod_timer(&pkc->retire_blk_timer, jiffies + pkc->tov_in_jiffies);
+}
+
+/* Start filling the active block; it must be owned by the kernel. */
+static void prb_open_block(struct tpacket_kbdq_core *pkc)
+{
+	struct tpacket_block_desc *pbd = prb_block(pkc, pkc->kactive_blk_num);
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+
+	smp_rmb();
+
+	pbd->version = TPACKET_V3;
+	pbd->offset_to_priv = BLK_HDR_LEN;
+	h1->seq_num = pkc->knxt_seq_num++;
+	h1->num_pkts = 0;
+	h1->offset_to_first_pkt = BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	h1->blk_len = h1->offset_to_first_pkt;
+
+	pkc->nxt_offset = (char *)pbd + h1->offset_to_first_pkt;
+	pkc->blk_end = (char *)pbd + pkc->kblk_size;
+	pkc->prev = NULL;
+	pkc->blk_frozen = 0;
+
+	prb_set_retire_timer(pkc);
+}
+
+/*
+ * Hand the active block over to user space and advance to the next one,
+ * once the copies still going on outside the lock have finished.
+ */
+static void prb_close_block(struct tpacket_kbdq_core *pkc,
+			    struct packet_sock *po, int status)
+{
+	struct tpacket_block_desc *pbd = prb_block(pkc, pkc->kactive_blk_num);
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+	struct sock *sk = &po->sk;
+
+	while (atomic_read(&pkc->blk_fill_in_prog))
+		cpu_relax();
+
+	if (po->stats.tp_drops)
+		status |= TP_STATUS_LOSING;
+
+	if (pkc->prev) {
+		struct tpacket3_hdr *first;
+
+		first = (struct tpacket3_hdr *)((char *)pbd +
+						h1->offset_to_first_pkt);
+		h1->ts_first_pkt.ts_sec = first->tp_sec;
+		h1->ts_first_pkt.ts_nsec = first->tp_nsec;
+		pkc->prev->tp_next_offset = 0;
+		h1->ts_last_pkt.ts_sec = pkc->prev->tp_sec;
+		h1->ts_last_pkt.ts_nsec = pkc->prev->tp_nsec;
+	} else {
+		struct timespec ts;
+
+		getnstimeofday(&ts);
+		h1->ts_first_pkt.ts_sec = ts.tv_sec;
+		h1->ts_first_pkt.ts_nsec = ts.tv_nsec;
+		h1->ts_last_pkt = h1->ts_first_pkt;
+	}
+
+	smp_wmb();
+#if ARCH_IMPLEMENTS_FLUSH_DCACHE_PAGE == 1
+	{
+		u8 *start, *end;
+
+		end = (u8 *)PAGE_ALIGN((unsigned long)pkc->blk_end);
+		for (start = (u8 *)pbd; start < end; start += PAGE_SIZE)
+			flush_dcache_page(pgv_to_page(start));
+		smp_wmb();
+	}
+#endif
+	h1->block_status = TP_STATUS_USER | status;
+	flush_dcache_page(pgv_to_page(&h1->block_status));
+	smp_wmb();
+
+	pkc->kactive_blk_num = prb_next_blk_num(pkc, pkc->kactive_blk_num);
+
+	sk->sk_data_ready(sk, 0);
+}
+
+/*
+ * Move on to the next block, or freeze the queue if user space has not
+ * given it back yet.  Returns false if the queue is frozen.
+ */
+static bool prb_dispatch_next_block(struct tpacket_kbdq_core *pkc,
+				    struct packet_sock *po)
+{
+	if (prb_block_status(prb_block(pkc, pkc->kactive_blk_num)) &
+	    TP_STATUS_USER) {
+		if (!pkc->blk_frozen)
+			po->stats.tp_freeze_q_cnt++;
+		pkc->blk_frozen = 1;
+		return false;
+	}
+	prb_open_block(pkc);
+	return true;
+}
+
+static void prb_retire_rx_blk_timer_expired(unsigned long data)
+{
+	struct packet_sock *po = (struct packet_sock *)data;
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	struct sock *sk = &po->sk;
+
+	spin_lock(&sk->sk_receive_queue.lock);
+
+	if (unlikely(pkc->delete_blk_timer))
+		goto out;
+
+	if (pkc->blk_frozen) {
+		/* User space may have released the block we stopped at. */
+		if (prb_dispatch_next_block(pkc, po))
+			goto out;
+	} else if (prb_block(pkc, pkc->kactive_blk_num)->hdr.bh1.num_pkts) {
+		/*
+		 * Opening a block rearms the timer, so the active one has
+		 * been open for a whole period.  Empty blocks are left alone:
+		 * retiring them would only cost user space a useless wakeup.
+		 */
+		prb_close_block(pkc, po, TP_STATUS_BLK_TMO);
+		if (prb_dispatch_next_block(pkc, po))
+			goto out;
+	}
+
+	prb_set_retire_timer(pkc);
+out:
+	spin_unlock(&sk->sk_receive_queue.lock);
+}
+
+static void prb_shutdown_retire_blk_timer(struct packet_sock *po)
+{
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	struct sk_buff_head *rb_queue = &po->sk.sk_receive_queue;
+
+	spin_lock_bh(&rb_queue->lock);
+	pkc->delete_blk_timer = 1;
+	spin_unlock_bh(&rb_queue->lock);
+
+	del_timer_sync(&pkc->retire_blk_timer);
+}
+
+/*
+ * Default the retire timeout to DEFAULT_PRB_RETIRE_TOV, and never let it
+ * be shorter than a jiffy.
+ */
+static void init_prb_bdqc(struct packet_sock *po,
+			  struct packet_ring_buffer *rb,
+			  struct tpacket_req3 *req3)
+{
+	struct tpacket_kbdq_core *pkc = &rb->prb_bdqc;
+
+	memset(pkc, 0, sizeof(*pkc));
+
+	pkc->pkbdq = rb->pg_vec;
+	pkc->knum_blocks = rb->pg_vec_len;
+	pkc->kblk_size = req3->tp_block_size;
+	pkc->blk_sizeof_priv = req3->tp_sizeof_priv;
+	pkc->feature_req_word = req3->tp_feature_req_word;
+	pkc->knxt_seq_num = 1;
+	atomic_set(&pkc->blk_fill_in_prog, 0);
+
+	pkc->retire_blk_tov = req3->tp_retire_blk_tov ? :
+			      DEFAULT_PRB_RETIRE_TOV;
+	pkc->tov_in_jiffies = msecs_to_jiffies(pkc->retire_blk_tov) ? : 1;
+
+	setup_timer(&pkc->retire_blk_timer, prb_retire_rx_blk_timer_expired,
+		    (unsigned long)po);
+
+	prb_open_block(pkc);
+}
+
+/*
+ * Reserve room for a frame of @len bytes in the active block, closing it
+ * and moving on to the next one if it does not fit.  Called with
+ * sk_receive_queue.lock held; returns NULL if the queue is frozen.
+ */
+static void *prb_lookup_frame_in_block(struct packet_sock *po,
+				       unsigned int len)
+{
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	struct tpacket_block_desc *pbd;
+	struct tpacket3_hdr *ppd;
+
+	if (pkc->blk_frozen && !prb_dispatch_next_block(pkc, po))
+		return NULL;
+
+	len = TPACKET_ALIGN(len);
+	if (pkc->nxt_offset + len > pkc->blk_end) {
+		prb_close_block(pkc, po, 0);
+		if (!prb_dispatch_next_block(pkc, po))
+			return NULL;
+	}
+
+	pbd = prb_block(pkc, pkc->kactive_blk_num);
+	ppd = (struct tpacket3_hdr *)pkc->nxt_offset;
+	if (pkc->prev)
+		pkc->prev->tp_next_offset = (char *)ppd - (char *)pkc->prev;
+	pkc->prev = ppd;
+	pkc->nxt_offset += len;
+
+	pbd->hdr.bh1.num_pkts++;
+	pbd->hdr.bh1.blk_len = pkc->nxt_offset - (char *)pbd;
+	atomic_inc(&pkc->blk_fill_in_prog);
+
+	return ppd;
+}
+
 static void packet_sock_destruct(struct sock *sk)
 {
 	skb_queue_purge(&sk->sk_error_queue);
@@ -985,6 +1264,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 	u8 *skb_head = skb->data;
@@ -1056,10 +1336,17 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	}
 
 	spin_lock(&sk->sk_receive_queue.lock);
-	h.raw = packet_current_frame(po, &po->rx_ring, TP_STATUS_KERNEL);
-	if (!h.raw)
-		goto ring_is_full;
-	packet_increment_head(&po->rx_ring);
+	if (po->tp_version == TPACKET_V3) {
+		h.raw = prb_lookup_frame_in_block(po, macoff + snaplen);
+		if (!h.raw)
+			goto ring_is_full;
+	} else {
+		h.raw = packet_current_frame(po, &po->rx_ring,
+					     TP_STATUS_KERNEL);
+		if (!h.raw)
+			goto ring_is_full;
+		packet_increment_head(&po->rx_ring);
+	}
 	po->stats.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
@@ -1117,6 +1404,41 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		h.h2->tp_padding = 0;
 		hdrlen = sizeof(*h.h2);
 		break;
+	case TPACKET_V3:
+	{
+		struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+
+		/* tp_next_offset belongs to the block code, leave it alone */
+		h.h3->tp_len = skb->len;
+		h.h3->tp_snaplen = snaplen;
+		h.h3->tp_mac = macoff;
+		h.h3->tp_net = netoff;
+		if ((po->tp_tstamp & SOF_TIMESTAMPING_SYS_HARDWARE)
+				&& shhwtstamps->syststamp.tv64)
+			ts = ktime_to_timespec(shhwtstamps->syststamp);
+		else if ((po->tp_tstamp & SOF_TIMESTAMPING_RAW_HARDWARE)
+				&& shhwtstamps->hwtstamp.tv64)
+			ts = ktime_to_timespec(shhwtstamps->hwtstamp);
+		else if (skb->tstamp.tv64)
+			ts = ktime_to_timespec(skb->tstamp);
+		else
+			getnstimeofday(&ts);
+		h.h3->tp_sec = ts.tv_sec;
+		h.h3->tp_nsec = ts.tv_nsec;
+		if (pkc->feature_req_word & TP_FT_REQ_FILL_RXHASH)
+			h.h3->hv1.tp_rxhash = skb_get_rxhash(skb);
+		else
+			h.h3->hv1.tp_rxhash = 0;
+		if (vlan_tx_tag_present(skb)) {
+			h.h3->hv1.tp_vlan_tci = vlan_tx_tag_get(skb);
+			status |= TP_STATUS_VLAN_VALID;
+		} else {
+			h.h3->hv1.tp_vlan_tci = 0;
+		}
+		h.h3->tp_status = status;
+		hdrlen = sizeof(*h.h3);
+		break;
+	}
 	default:
 		BUG();
 	}
@@ -1143,9 +1465,14 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		smp_wmb();
 	}
 #endif
-	__packet_set_status(po, h.raw, status);
-
-	sk->sk_data_ready(sk, 0);
+	if (po->tp_version == TPACKET_V3) {
+		/* The reader is woken up once the whole block is closed. */
+		smp_mb__before_atomic_dec();
+		atomic_dec(&po->rx_ring.prb_bdqc.blk_fill_in_prog);
+	} else {
+		__packet_set_status(po, h.raw, status);
+		sk->sk_data_ready(sk, 0);
+	}
 
 drop_n_restore:
 	if (skb_head != skb->data && skb_shared(skb)) {
@@ -1634,7 +1961,7 @@ static int packet_release(struct socket *sock)
 	struct sock *sk = sock->sk;
 	struct packet_sock *po;
 	struct net *net;
-	struct tpacket_req req;
+	union tpacket_req_u req_u;
 
 	if (!sk)
 		return 0;
@@ -1657,13 +1984,13 @@ static int packet_release(struct socket *sock)
 
 	packet_flush_mclist(sk);
 
-	memset(&req, 0, sizeof(req));
+	memset(&req_u, 0, sizeof(req_u));
 
 	if (po->rx_ring.pg_vec)
-		packet_set_ring(sk, &req, 1, 0);
+		packet_set_ring(sk, &req_u, 1, 0);
 
 	if (po->tx_ring.pg_vec)
-		packet_set_ring(sk, &req, 1, 1);
+		packet_set_ring(sk, &req_u, 1, 1);
 
 	fanout_release(sk);
 
@@ -2283,15 +2610,21 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 	case PACKET_RX_RING:
 	case PACKET_TX_RING:
 	{
-		struct tpacket_req req;
+		union tpacket_req_u req_u;
+		int len;
 
-		if (optlen < sizeof(req))
+		if (po->tp_version == TPACKET_V3)
+			len = sizeof(req_u.req3);
+		else
+			len = sizeof(req_u.req);
+		if (optlen < len)
 			return -EINVAL;
 		if (pkt_sk(sk)->has_vnet_hdr)
 			return -EINVAL;
-		if (copy_from_user(&req, optval, sizeof(req)))
+		if (copy_from_user(&req_u, optval, len))
 			return -EFAULT;
-		return packet_set_ring(sk, &req, 0, optname == PACKET_TX_RING);
+		return packet_set_ring(sk, &req_u, 0,
+				       optname == PACKET_TX_RING);
 	}
 	case PACKET_COPY_THRESH:
 	{
@@ -2318,6 +2651,7 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		switch (val) {
 		case TPACKET_V1:
 		case TPACKET_V2:
+		case TPACKET_V3:
 			po->tp_version = val;
 			return 0;
 		default:
@@ -2426,7 +2760,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 	void *data;
-	struct tpacket_stats st;
+	struct tpacket_stats_v3 st;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -2439,8 +2773,13 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 
 	switch (optname) {
 	case PACKET_STATISTICS:
-		if (len > sizeof(struct tpacket_stats))
-			len = sizeof(struct tpacket_stats);
+		if (po->tp_version == TPACKET_V3) {
+			if (len > sizeof(struct tpacket_stats_v3))
+				len = sizeof(struct tpacket_stats_v3);
+		} else {
+			if (len > sizeof(struct tpacket_stats))
+				len = sizeof(struct tpacket_stats);
+		}
 		spin_lock_bh(&sk->sk_receive_queue.lock);
 		st = po->stats;
 		memset(&po->stats, 0, sizeof(st));
@@ -2488,6 +2827,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		case TPACKET_V2:
 			val = sizeof(struct tpacket2_hdr);
 			break;
+		case TPACKET_V3:
+			val = sizeof(struct tpacket3_hdr);
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -2644,7 +2986,17 @@ static unsigned int packet_poll(struct file *file, struct socket *sock,
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
 	if (po->rx_ring.pg_vec) {
-		if (!packet_previous_frame(po, &po->rx_ring, TP_STATUS_KERNEL))
+		if (po->tp_version == TPACKET_V3) {
+			struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+			unsigned int prev = pkc->kactive_blk_num ?
+					    pkc->kactive_blk_num - 1 :
+					    pkc->knum_blocks - 1;
+
+			if (prb_block_status(prb_block(pkc, prev)) &
+			    TP_STATUS_USER)
+				mask |= POLLIN | POLLRDNORM;
+		} else if (!packet_previous_frame(po, &po->rx_ring,
+						  TP_STATUS_KERNEL))
 			mask |= POLLIN | POLLRDNORM;
 	}
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
@@ -2763,9 +3115,10 @@ out_free_pgvec:
 	goto out;
 }
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		int closing, int tx_ring)
 {
+	struct tpacket_req *req = &req_u->req;
 	struct pgv *pg_vec = NULL;
 	struct packet_sock *po = pkt_sk(sk);
 	int was_running, order = 0;
@@ -2798,6 +3151,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 		case TPACKET_V2:
 			po->tp_hdrlen = TPACKET2_HDRLEN;
 			break;
+		case TPACKET_V3:
+			po->tp_hdrlen = TPACKET3_HDRLEN;
+			break;
 		}
 
 		err = -EINVAL;
@@ -2810,6 +3166,18 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 			goto out;
 		if (unlikely(req->tp_frame_size & (TPACKET_ALIGNMENT - 1)))
 			goto out;
+		if (po->tp_version == TPACKET_V3) {
+			/* Block-based rings only exist for rx. */
+			if (unlikely(tx_ring))
+				goto out;
+			if (unlikely(req_u->req3.tp_sizeof_priv >=
+				     req->tp_block_size))
+				goto out;
+			if (unlikely(req->tp_frame_size >
+				     req->tp_block_size -
+				     BLK_PLUS_PRIV(req_u->req3.tp_sizeof_priv)))
+				goto out;
+		}
 
 		rb->frames_per_block = req->tp_block_size/req->tp_frame_size;
 		if (unlikely(rb->frames_per_block <= 0))
@@ -2849,6 +3217,8 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 	mutex_lock(&po->pg_vec_lock);
 	if (closing || atomic_read(&po->mapped) == 0) {
 		err = 0;
+		if (po->tp_version == TPACKET_V3 && !tx_ring && rb->pg_vec)
+			prb_shutdown_retire_blk_timer(po);
 		spin_lock_bh(&rb_queue->lock);
 		swap(rb->pg_vec, pg_vec);
 		rb->frame_max = (req->tp_frame_nr - 1);
@@ -2860,6 +3230,11 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 		swap(rb->pg_vec_len, req->tp_block_nr);
 
 		rb->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
+		if (po->tp_version == TPACKET_V3 && !tx_ring && rb->pg_vec) {
+			spin_lock_bh(&rb_queue->lock);
+			init_prb_bdqc(po, rb, &req_u->req3);
+			spin_unlock_bh(&rb_queue->lock);
+		}
 		po->prot_hook.func = (po->rx_ring.pg_vec) ?
 						tpacket_rcv : packet_rcv;
 		skb_queue_purge(rb_queue);
@@ -0,0 +1,278 @@
+/*
+ *
+ * epoll-wait.c
+ *
+ * wait: Benchmark for epoll_wait() wakeups
+ *
+ * A set of writer threads signal their own eventfd in a loop, while a set
+ * of waiter threads, each with a private epoll instance watching all the
+ * eventfds, consume the events. With --exclusive the eventfds are added
+ * with EPOLLEXCLUSIVE, so an event wakes a single waiter instead of all of
+ * them. The number of wakeups that found nothing to consume shows how
+ * much of a thundering herd is left.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+#define EPOLL_MAXEVENTS 64
+
+static int nwaiters;
+static int nwriters;
+static int loops = 100000;
+static bool exclusive;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "waiters", &nwaiters,
+		    "Specify number of waiter threads (default: online CPUs)"),
+	OPT_INTEGER('w', "writers", &nwriters,
+		    "Specify number of writer threads (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of events signalled per writer"),
+	OPT_BOOLEAN('x', "exclusive", &exclusive,
+		    "Add the eventfds with EPOLLEXCLUSIVE"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+struct waiter {
+	pthread_t		thread;
+	int			epfd;
+	unsigned long		wakeups;
+	unsigned long		spurious;
+	volatile unsigned long	consumed;
+};
+
+struct writer {
+	pthread_t		thread;
+	int			fd;
+};
+
+static struct waiter *waiters;
+static struct writer *writers;
+static pthread_barrier_t start_barrier;
+static volatile int done;
+static int stop_fd;
+
+static void *waiter_thread(void *arg)
+{
+	struct waiter *w = arg;
+	struct epoll_event ev[EPOLL_MAXEVENTS];
+	uint64_t val;
+	int i, n;
+
+	pthread_barrier_wait(&start_barrier);
+
+	while (!done) {
+		n = epoll_wait(w->epfd, ev, EPOLL_MAXEVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait: %s", strerror(errno));
+		}
+
+		w->wakeups++;
+		for (i = 0; i < n; i++) {
+			if (ev[i].data.fd == stop_fd)
+				continue;
+			if (read(ev[i].data.fd, &val, sizeof(val)) != sizeof(val)) {
+				if (errno != EAGAIN)
+					die("read: %s", strerror(errno));
+				w->spurious++;
+				continue;
+			}
+			w->consumed += val;
+		}
+	}
+
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	uint64_t val = 1;
+	int i;
+
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < loops; i++) {
+		if (write(w->fd, &val, sizeof(val)) != sizeof(val))
+			die("write: %s", strerror(errno));
+	}
+
+	return NULL;
+}
+
+static unsigned long total_consumed(void)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < nwaiters; i++)
+		sum += waiters[i].consumed;
+
+	return sum;
+}
+
+static void epoll_add(int epfd, int fd, unsigned int events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+		die("epoll_ctl: %s", strerror(errno));
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, nr_events;
+	unsigned long wakeups = 0, spurious = 0;
+	uint64_t val = 1;
+	int i, j;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_wait_usage, 0);
+	if (argc)
+		usage_with_options(bench_epoll_wait_usage, options);
+
+	if (nwaiters <= 0)
+		nwaiters = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nwriters <= 0)
+		nwriters = sysconf(_SC_NPROCESSORS_ONLN);
+
+	waiters = zalloc(nwaiters * sizeof(*waiters));
+	writers = zalloc(nwriters * sizeof(*writers));
+	if (!waiters || !writers)
+		die("zalloc: out of memory");
+
+	/* Level triggered and never read, so it wakes every waiter */
+	stop_fd = eventfd(0, EFD_NONBLOCK);
+	if (stop_fd < 0)
+		die("eventfd: %s", strerror(errno));
+
+	for (j = 0; j < nwriters; j++) {
+		writers[j].fd = eventfd(0, EFD_NONBLOCK);
+		if (writers[j].fd < 0)
+			die("eventfd: %s", strerror(errno));
+	}
+
+	for (i = 0; i < nwaiters; i++) {
+		waiters[i].epfd = epoll_create1(0);
+		if (waiters[i].epfd < 0)
+			die("epoll_create1: %s", strerror(errno));
+
+		for (j = 0; j < nwriters; j++)
+			epoll_add(waiters[i].epfd, writers[j].fd,
+				  EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0));
+		epoll_add(waiters[i].epfd, stop_fd, EPOLLIN);
+	}
+
+	if (pthread_barrier_init(&start_barrier, NULL,
+				 nwaiters + nwriters + 1))
+		die("pthread_barrier_init");
+
+	for (i = 0; i < nwaiters; i++)
+		if (pthread_create(&waiters[i].thread, NULL,
+				   waiter_thread, &waiters[i]))
+			die("pthread_create");
+	for (j = 0; j < nwriters; j++)
+		if (pthread_create(&writers[j].thread, NULL,
+				   writer_thread, &writers[j]))
+			die("pthread_create");
+
+	pthread_barrier_wait(&start_barrier);
+	gettimeofday(&start, NULL);
+
+	for (j = 0; j < nwriters; j++)
+		pthread_join(writers[j].thread, NULL);
+
+	nr_events = (unsigned long long)nwriters * loops;
+	while (total_consumed() < nr_events)
+		usleep(100);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	done = 1;
+	if (write(stop_fd, &val, sizeof(val)) != sizeof(val))
+		die("write: %s", strerror(errno));
+
+	for (i = 0; i < nwaiters; i++) {
+		pthread_join(waiters[i].thread, NULL);
+		wakeups += waiters[i].wakeups;
+		spurious += waiters[i].spurious;
+		close(waiters[i].epfd);
+	}
+	for (j = 0; j < nwriters; j++)
+		close(writers[j].fd);
+	close(stop_fd);
+	pthread_barrier_destroy(&start_barrier);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d writers signalling %d events each to %d waiters%s\n\n",
+		       nwriters, loops, nwaiters,
+		       exclusive ? " (EPOLLEXCLUSIVE)" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/event\n",
+		       (double)result_usec / (double)nr_events);
+		printf(" %14d events/sec\n",
+		       (int)((double)nr_events /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14lu wakeups\n", wakeups);
+		printf(" %14lu spurious wakeups\n", spurious);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(waiters);
+	free(writers);
+
+	return 0;
+}
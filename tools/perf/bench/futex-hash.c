@@ -0,0 +1,182 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for the futex hash table
+ *
+ * Every thread spins on FUTEX_WAIT calls with a value that never matches,
+ * over its own set of futexes. Each call hashes the key and takes the
+ * bucket lock, then returns EWOULDBLOCK without sleeping, so the result
+ * measures hashing and bucket lock contention only.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+static unsigned int nthreads;
+static unsigned int nfutexes = 1024;
+static unsigned int nsecs = 10;
+static bool fshared;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online CPUs)"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify number of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t		thread;
+	u_int32_t		*futex;
+	unsigned long		ops;
+};
+
+static pthread_barrier_t start_barrier;
+static volatile int done;
+static int futex_flag;
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	unsigned int i;
+	int ret;
+
+	pthread_barrier_wait(&start_barrier);
+
+	do {
+		for (i = 0; i < nfutexes; i++, ops++) {
+			/*
+			 * We want the futex calls to fail in order to stress
+			 * the hashing of uaddr and not measure other steps,
+			 * such as internal waitqueue handling, thus enlarging
+			 * the critical region protected by hb->lock.
+			 */
+			ret = futex_wait(&w->futex[i], 1234, NULL, futex_flag);
+			if (!done && (!ret || (errno != EAGAIN &&
+					       errno != EWOULDBLOCK)))
+				die("futex_wait: %s", strerror(errno));
+		}
+	} while (!done);
+
+	w->ops = ops;
+
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long long total = 0;
+	unsigned long long result_usec;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nfutexes)
+		nfutexes = 1;
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	workers = zalloc(nthreads * sizeof(*workers));
+	if (!workers)
+		die("zalloc: out of memory");
+
+	if (pthread_barrier_init(&start_barrier, NULL, nthreads + 1))
+		die("pthread_barrier_init");
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].futex = zalloc(nfutexes * sizeof(*workers[i].futex));
+		if (!workers[i].futex)
+			die("zalloc: out of memory");
+		if (pthread_create(&workers[i].thread, NULL,
+				   worker_thread, &workers[i]))
+			die("pthread_create");
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	gettimeofday(&start, NULL);
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+		free(workers[i].futex);
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	pthread_barrier_destroy(&start_barrier);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads operating on %u %s futexes each\n\n",
+		       nthreads, nfutexes, fshared ? "shared" : "private");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14llu ops\n", total);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total /
+					    ((double)result_usec / 1000000)));
+		printf(" %14llu ops/sec per thread\n",
+		       (unsigned long long)((double)total / nthreads /
+					    ((double)result_usec / 1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n",
+		       (unsigned long long)((double)total /
+					    ((double)result_usec / 1000000)));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+
+	return 0;
+}
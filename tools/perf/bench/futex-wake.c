@@ -0,0 +1,151 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Benchmark for FUTEX_WAKE
+ *
+ * A set of threads block on a single futex, and the main thread wakes
+ * them up, a configurable number at a time, measuring how long it takes
+ * to wake all of them.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int loops = 10;
+static bool fshared;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online CPUs)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify number of threads to wake up per call"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of wake up rounds"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static u_int32_t futex1;
+static int futex_flag;
+static pthread_barrier_t start_barrier;
+
+static void *waiter_thread(void *arg __used)
+{
+	pthread_barrier_wait(&start_barrier);
+
+	while (futex_wait(&futex1, 0, NULL, futex_flag)) {
+		if (errno != EINTR)
+			die("futex_wait: %s", strerror(errno));
+	}
+
+	return NULL;
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	pthread_t *threads;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec = 0;
+	unsigned int i, j, woken;
+	int ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes)
+		nwakes = 1;
+	if (!loops)
+		loops = 1;
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	threads = zalloc(nthreads * sizeof(*threads));
+	if (!threads)
+		die("zalloc: out of memory");
+
+	for (j = 0; j < loops; j++) {
+		if (pthread_barrier_init(&start_barrier, NULL, nthreads + 1))
+			die("pthread_barrier_init");
+
+		for (i = 0; i < nthreads; i++)
+			if (pthread_create(&threads[i], NULL,
+					   waiter_thread, NULL))
+				die("pthread_create");
+
+		pthread_barrier_wait(&start_barrier);
+
+		/* Give the waiters a chance to block on the futex */
+		usleep(100000);
+
+		gettimeofday(&start, NULL);
+		for (woken = 0; woken < nthreads; woken += ret) {
+			ret = futex_wake(&futex1, nwakes, futex_flag);
+			if (ret < 0)
+				die("futex_wake: %s", strerror(errno));
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+
+		result_usec += diff.tv_sec * 1000000;
+		result_usec += diff.tv_usec;
+
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+		pthread_barrier_destroy(&start_barrier);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Waking %u threads %u at a time, %u rounds\n\n",
+		       nthreads, nwakes, loops);
+
+		printf(" %14lf msecs/round\n",
+		       (double)result_usec / loops / 1000);
+		printf(" %14lf usecs/wakeup\n",
+		       (double)result_usec / loops / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)result_usec / loops / 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(threads);
+
+	return 0;
+}
@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  epoll ... epoll wakeup scalability
+ *  futex ... futex hashing and wake up operations
  *
  */
 
@@ -58,6 +60,32 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Writers signalling eventfds watched by many epoll waiters",
+	  bench_epoll_wait },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Benchmark for futex hash table",
+	  bench_futex_hash },
+	{ "wake",
+	  "Benchmark for futex wake calls",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Benchmark for futex requeue calls",
+	  bench_futex_requeue },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +99,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "epoll",
+	  "epoll wakeup scalability",
+	  epoll_suites },
+	{ "futex",
+	  "futex hashing and wake up operations",
+	  futex_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
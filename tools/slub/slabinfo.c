@@ -42,6 +42,8 @@ struct slabinfo {
 	unsigned long deactivate_remote_frees, order_fallback;
 	unsigned long cmpxchg_double_cpu_fail, cmpxchg_double_fail;
 	unsigned long alloc_node_mismatch, deactivate_bypass;
+	unsigned long cpu_partial_alloc, cpu_partial_free;
+	unsigned long cpu_partial_node, cpu_partial_drain;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -462,6 +464,16 @@ static void slab_stats(struct slabinfo *s)
 
 	printf("Total                %8lu %8lu\n\n", total_alloc, total_free);
 
+	if (s->cpu_partial_alloc || s->cpu_partial_free)
+		printf("Cpu partial list     %8lu %8lu %3lu %3lu\n",
+			s->cpu_partial_alloc, s->cpu_partial_free,
+			s->cpu_partial_alloc * 100 / total_alloc,
+			s->cpu_partial_free * 100 / total_free);
+
+	if (s->cpu_partial_node || s->cpu_partial_drain)
+		printf("Cpu partial node refills %lu drains %lu\n\n",
+			s->cpu_partial_node, s->cpu_partial_drain);
+
 	if (s->cpuslab_flush)
 		printf("Flushes %8lu\n", s->cpuslab_flush);
 
@@ -1211,6 +1223,10 @@ static void read_slab_dir(void)
 			slab->cmpxchg_double_fail = get_obj("cmpxchg_double_fail");
 			slab->alloc_node_mismatch = get_obj("alloc_node_mismatch");
 			slab->deactivate_bypass = get_obj("deactivate_bypass");
+			slab->cpu_partial_alloc = get_obj("cpu_partial_alloc");
+			slab->cpu_partial_free = get_obj("cpu_partial_free");
+			slab->cpu_partial_node = get_obj("cpu_partial_node");
+			slab->cpu_partial_drain = get_obj("cpu_partial_drain");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;